@@ -43,6 +43,7 @@
 #include "args.h"
 #include "eval.h"
 #include "arith.h"
+#include "ffi.h"
 
 #define TAG_PAIR(A, B) ((A) << TAG_SHIFT | (B))
 #define NOOP(A, B)
@@ -523,6 +524,8 @@ tail:
     if (type(anum) == RNG)
       return rcons(plus(from(anum), bnum), plus(to(anum), bnum));
   }
+  if (carrayp(anum) || carrayp(bnum))
+    return carray_plus(anum, bnum);
   uw_throwf(error_s, lit("+: invalid operands ~s ~s"), anum, bnum, nao);
 char_range:
   uw_throwf(numeric_error_s,
@@ -672,6 +675,8 @@ tail:
     if (type(anum) == RNG)
       return rcons(minus(from(anum), bnum), minus(to(anum), bnum));
   }
+  if (carrayp(anum) || carrayp(bnum))
+    return carray_minus(anum, bnum);
   uw_throwf(error_s, lit("-: invalid operands ~s ~s"), anum, bnum, nao);
 }
 
@@ -853,6 +858,8 @@ tail:
       break;
     }
   }
+  if (carrayp(anum) || carrayp(bnum))
+    return carray_mul(anum, bnum);
   uw_throwf(error_s, lit("*: invalid operands ~s ~s"), anum, bnum, nao);
 }
 
@@ -2675,10 +2682,35 @@ val cum_norm_dist(val arg)
   }
 }
 
-static val rising_product(val m, val n)
+/* Product of the integers from m to n, m <= n.  Long ranges are
+ * split in half, so that the large multiplications are between
+ * operands of similar size, which bignum multiplication handles
+ * much better than repeatedly multiplying a growing product by a
+ * small factor.
+ */
+static val range_product(val m, val n)
 {
-  val acc;
+  val len = minus(n, m);
+
+  if (lt(len, num_fast(16))) {
+    val acc = m;
+
+    m = plus(m, one);
+
+    while (le(m, n)) {
+      acc = mul(acc, m);
+      m = plus(m, one);
+    }
+
+    return acc;
+  } else {
+    val mid = plus(m, ash(len, negone));
+    return mul(range_product(m, mid), range_product(plus(mid, one), n));
+  }
+}
 
+static val rising_product(val m, val n)
+{
   if (lt(n, one))
     return one;
 
@@ -2688,16 +2720,7 @@ static val rising_product(val m, val n)
   if (lt(m, one))
     m = one;
 
-  acc = m;
-
-  m = plus(m, one);
-
-  while (le(m, n)) {
-    acc = mul(acc, m);
-    m = plus(m, one);
-  }
-
-  return acc;
+  return range_product(m, n);
 }
 
 val n_choose_k(val n, val k)
@@ -36,6 +36,14 @@
 #include <stdio.h>
 #include <dirent.h>
 #include "config.h"
+#if HAVE_MMAP
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
 #include "lib.h"
 #include "gc.h"
 #include "itypes.h"
@@ -44,6 +52,8 @@
 #include "eval.h"
 #include "stream.h"
 #include "arith.h"
+#include "utf8.h"
+#include "hash.h"
 #include "buf.h"
 
 static cnum buf_check_len(val len, val self)
@@ -167,6 +177,167 @@ static void buf_shrink(struct buf *b)
   }
 }
 
+#if HAVE_MMAP
+
+static val mmap_hash;
+
+/*
+ * A mapped buffer is a fixed buffer whose data points into the
+ * mapping. The hash associates it with a list of the offset of the
+ * data from the page-aligned start of the mapping, the mapping's
+ * length, which is zero once unmapped, and whether it is shared.
+ * The same list is the environment of its finalizer.
+ */
+static void buf_unmap(val buf, val info, val self)
+{
+  struct buf *b = coerce(struct buf *, buf);
+  size_t maplen = c_unum(second(info));
+
+  if (maplen > 0) {
+    mem_t *base = b->data - c_num(first(info));
+    int err = 0;
+
+    if (third(info) && msync(base, maplen, MS_SYNC) < 0)
+      err = errno;
+    if (munmap(base, maplen) < 0 && err == 0)
+      err = errno;
+
+    b->data = 0;
+    b->len = zero;
+    rplaca(cdr(info), zero);
+
+    if (err && self)
+      uw_throwf(file_error_s, lit("~a: unable to unmap ~s: ~d/~s"),
+                self, buf, num(err), errno_to_string(num(err)), nao);
+  }
+}
+
+static val mmap_buf_finalize(val info, val buf)
+{
+  buf_unmap(buf, info, nil);
+  return nil;
+}
+
+static val mmap_info(val buf, val self)
+{
+  val info = gethash(mmap_hash, buf);
+  if (!info)
+    uw_throwf(error_s, lit("~a: ~s is not a mapped buffer"),
+              self, buf, nao);
+  return info;
+}
+
+val mmap_buf(val path, val mode_str, val offset_in, val len_in)
+{
+  val self = lit("mmap-buf");
+  val mode = default_arg(mode_str, lit("r"));
+  cnum off = buf_check_index(default_arg(offset_in, zero), self);
+  int shared, fd, err;
+  char *name;
+  struct stat st;
+  cnum len, delta;
+  size_t maplen;
+  mem_t *base = 0;
+  val buf, info;
+
+  if (equal(mode, lit("r")))
+    shared = 0;
+  else if (equal(mode, lit("r+")))
+    shared = 1;
+  else
+    uw_throwf(error_s, lit("~a: mode ~s isn't \"r\" or \"r+\""),
+              self, mode, nao);
+
+  name = utf8_dup_to(c_str(path));
+  fd = open(name, if3(shared, O_RDWR, O_RDONLY));
+  free(name);
+
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    err = errno;
+    if (fd >= 0)
+      close(fd);
+    uw_throwf(file_error_s, lit("~a: unable to open ~a: ~d/~s"),
+              self, path, num(err), errno_to_string(num(err)), nao);
+  }
+
+  if (off > st.st_size) {
+    close(fd);
+    uw_throwf(error_s, lit("~a: offset ~s is past the end of ~a"),
+              self, num(off), path, nao);
+  }
+
+  len = if3(null_or_missing_p(len_in), st.st_size - off,
+            buf_check_len(len_in, self));
+
+  if (len > st.st_size - off) {
+    close(fd);
+    uw_throwf(error_s, lit("~a: ~s bytes at offset ~s exceed the size of ~a"),
+              self, num(len), num(off), path, nao);
+  }
+
+  delta = off % sysconf(_SC_PAGESIZE);
+  maplen = len + delta;
+
+  /* A private mapping is copy-on-write: the buffer may be
+     modified without altering the file. */
+  if (len > 0) {
+    void *addr = mmap(0, maplen, PROT_READ | PROT_WRITE,
+                      if3(shared, MAP_SHARED, MAP_PRIVATE), fd, off - delta);
+
+    if (addr == MAP_FAILED) {
+      err = errno;
+      close(fd);
+      uw_throwf(file_error_s, lit("~a: unable to map ~a: ~d/~s"),
+                self, path, num(err), errno_to_string(num(err)), nao);
+    }
+
+    base = coerce(mem_t *, addr);
+
+    /* Count the mapping toward GC pressure, like malloced memory,
+       so that unreachable mapped buffers get finalized. */
+    malloc_bytes += maplen;
+  } else {
+    maplen = 0;
+  }
+
+  close(fd);
+
+  buf = make_borrowed_buf(num(len), if3(base, base + delta, 0));
+  info = list(num(delta), unum(maplen), tnil(shared), nao);
+  sethash(mmap_hash, buf, info);
+  gc_finalize(buf, func_f1(info, mmap_buf_finalize), nil);
+  return buf;
+}
+
+val msync_buf(val buf)
+{
+  val self = lit("msync-buf");
+  val info = mmap_info(buf, self);
+  struct buf *b = coerce(struct buf *, buf);
+  size_t maplen = c_unum(second(info));
+
+  if (third(info) && maplen > 0 &&
+      msync(b->data - c_num(first(info)), maplen, MS_SYNC) < 0)
+  {
+    int err = errno;
+    uw_throwf(file_error_s, lit("~a: unable to sync ~s: ~d/~s"),
+              self, buf, num(err), errno_to_string(num(err)), nao);
+  }
+
+  return t;
+}
+
+val munmap_buf(val buf)
+{
+  val self = lit("munmap-buf");
+  val info = mmap_info(buf, self);
+  remhash(mmap_hash, buf);
+  buf_unmap(buf, info, self);
+  return t;
+}
+
+#endif
+
 val buf_trim(val buf)
 {
   val self = lit("buf-trim");
@@ -417,7 +588,7 @@ static void buf_get_bytes(val buf, val pos, mem_t *ptr, cnum size, val self)
   cnum e = p + size;
   cnum l = c_num(b->len);
 
-  if (e >= l || e < 0)
+  if (e > l || e < 0)
     uw_throwf(error_s, lit("~a: attempted read past buffer end"), self, nao);
 
   memcpy(ptr, b->data + p, size);
@@ -654,6 +825,14 @@ void buf_init(void)
   reg_fun(intern(lit("buf-set-length"), user_package), func_n3o(buf_set_length, 2));
   reg_fun(intern(lit("length-buf"), user_package), func_n1(length_buf));
 
+#if HAVE_MMAP
+  prot1(&mmap_hash);
+  mmap_hash = make_hash(t, nil, nil);
+  reg_fun(intern(lit("mmap-buf"), user_package), func_n4o(mmap_buf, 1));
+  reg_fun(intern(lit("msync-buf"), user_package), func_n1(msync_buf));
+  reg_fun(intern(lit("munmap-buf"), user_package), func_n1(munmap_buf));
+#endif
+
 #if HAVE_I8
   reg_fun(intern(lit("buf-put-i8"), user_package), func_n3(buf_put_i8));
   reg_fun(intern(lit("buf-put-u8"), user_package), func_n3(buf_put_u8));
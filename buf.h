@@ -29,6 +29,11 @@ val make_buf(val len, val init_val, val alloc_size);
 val bufp(val object);
 val make_borrowed_buf(val len, mem_t *data);
 val make_duplicate_buf(val len, mem_t *data);
+#if HAVE_MMAP
+val mmap_buf(val path, val mode_str, val offset, val len);
+val msync_buf(val buf);
+val munmap_buf(val buf);
+#endif
 val buf_trim(val buf);
 val buf_set_length(val obj, val len, val init_val);
 val length_buf(val buf);
@@ -3911,7 +3911,7 @@ val load(val target)
   env_vbind(dyn_env, load_recursive_s, t);
   env_vbind(dyn_env, package_s, cur_package);
 
-  if (!read_eval_stream(stream, std_error)) {
+  if (!read_eval_stream(stream, std_error, t)) {
     close_stream(stream, nil);
     uw_throwf(error_s, lit("load: ~a contains errors"), path, nao);
   }
@@ -6040,9 +6040,9 @@ void eval_init(void)
   reg_fun(intern(lit("str>"), user_package), func_n2(str_gt));
   reg_fun(intern(lit("str<="), user_package), func_n2(str_le));
   reg_fun(intern(lit("str>="), user_package), func_n2(str_ge));
-  reg_fun(intern(lit("int-str"), user_package), func_n2o(int_str, 1));
-  reg_fun(intern(lit("flo-str"), user_package), func_n1(flo_str));
-  reg_fun(intern(lit("num-str"), user_package), func_n1(num_str));
+  reg_fun(intern(lit("int-str"), user_package), func_n4o(int_substr, 1));
+  reg_fun(intern(lit("flo-str"), user_package), func_n3o(flo_substr, 1));
+  reg_fun(intern(lit("num-str"), user_package), func_n3o(num_substr, 1));
   reg_fun(intern(lit("int-flo"), user_package), func_n1(int_flo));
   reg_fun(intern(lit("flo-int"), user_package), func_n1(flo_int));
   reg_fun(intern(lit("tofloat"), user_package), func_n1(tofloat));
@@ -6235,6 +6235,7 @@ void eval_init(void)
   reg_fun(intern(lit("time-parse"), user_package), func_n2(time_parse));
   reg_fun(intern(lit("time-parse-local"), user_package), func_n2(time_parse_local));
   reg_fun(intern(lit("time-parse-utc"), user_package), func_n2(time_parse_utc));
+  reg_fun(intern(lit("time-parser"), user_package), func_n2o(time_parser, 1));
 
   reg_fun(intern(lit("source-loc"), user_package), func_n1(source_loc));
   reg_fun(intern(lit("source-loc-str"), user_package), func_n2o(source_loc_str, 1));
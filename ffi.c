@@ -155,6 +155,7 @@ struct smemb {
   val mtype;
   struct txr_ffi_type *mtft;
   cnum offs;
+  cnum slidx;
 };
 
 struct txr_ffi_type {
@@ -515,6 +516,17 @@ static val ffi_u32_get(struct txr_ffi_type *tft, mem_t *src, val self)
 #endif
 
 #if HAVE_I64
+static val num_i64(i64_t n)
+{
+  if (sizeof (i64_t) <= sizeof (cnum)) {
+    return num(n);
+  } else {
+    val high = num(n >> 32);
+    val low = unum(n & 0xFFFFFFFF);
+    return logior(ash(high, num_fast(32)), low);
+  }
+}
+
 static void ffi_i64_put(struct txr_ffi_type *tft, val n, mem_t *dst, val self)
 {
   i64_t v = c_i64(n, self);
@@ -525,14 +537,7 @@ static val ffi_i64_get(struct txr_ffi_type *tft, mem_t *src, val self)
 {
   align_sw_get(i64_t, src);
   i64_t n = *coerce(i64_t *, src);
-
-  if (sizeof (i64_t) <= sizeof (cnum)) {
-    return num(n);
-  } else {
-    val high = num(n >> 32);
-    val low = unum(n & 0xFFFFFFFF);
-    return logior(ash(high, num_fast(32)), low);
-  }
+  return num_i64(n);
   align_sw_end;
 }
 
@@ -2138,11 +2143,12 @@ static val ffi_struct_in(struct txr_ffi_type *tft, int copy, mem_t *src,
     ucnum offs = memb[i].offs;
     if (slsym) {
       if (mtft->in != 0) {
-        val slval = slot(strct, slsym);
-        slotset(strct, slsym, mtft->in(mtft, copy, src + offs, slval, self));
+        val slval = slot_by_index(strct, tft->lt, memb[i].slidx, slsym);
+        slotset_by_index(strct, tft->lt, memb[i].slidx, slsym,
+                         mtft->in(mtft, copy, src + offs, slval, self));
       } else if (copy) {
         val slval = mtft->get(mtft, src + offs, self);
-        slotset(strct, slsym, slval);
+        slotset_by_index(strct, tft->lt, memb[i].slidx, slsym, slval);
       }
     }
   }
@@ -2161,7 +2167,7 @@ static void ffi_struct_put(struct txr_ffi_type *tft, val strct, mem_t *dst,
     struct txr_ffi_type *mtft = memb[i].mtft;
     ucnum offs = memb[i].offs;
     if (slsym) {
-      val slval = slot(strct, slsym);
+      val slval = slot_by_index(strct, tft->lt, memb[i].slidx, slsym);
       mtft->put(mtft, slval, dst + offs, self);
     }
   }
@@ -2179,10 +2185,10 @@ static void ffi_struct_out(struct txr_ffi_type *tft, int copy, val strct,
     ucnum offs = memb[i].offs;
     if (slsym) {
       if (mtft->out != 0) {
-        val slval = slot(strct, slsym);
+        val slval = slot_by_index(strct, tft->lt, memb[i].slidx, slsym);
         mtft->out(mtft, copy, slval, dst + offs, self);
       } else if (copy) {
-        val slval = slot(strct, slsym);
+        val slval = slot_by_index(strct, tft->lt, memb[i].slidx, slsym);
         mtft->put(mtft, slval, dst + offs, self);
       }
     }
@@ -2202,7 +2208,7 @@ static val ffi_struct_get(struct txr_ffi_type *tft, mem_t *src, val self)
     ucnum offs = memb[i].offs;
     if (slsym) {
       val slval = mtft->get(mtft, src + offs, self);
-      slotset(strct, slsym, slval);
+      slotset_by_index(strct, tft->lt, memb[i].slidx, slsym, slval);
     }
   }
 
@@ -2223,7 +2229,7 @@ static void ffi_struct_release(struct txr_ffi_type *tft, val strct, mem_t *dst)
     ucnum offs = memb[i].offs;
     if (slsym) {
       if (mtft->release != 0) {
-        val slval = slot(strct, slsym);
+        val slval = slot_by_index(strct, tft->lt, memb[i].slidx, slsym);
         mtft->release(mtft, slval, dst + offs);
       }
     }
@@ -2874,6 +2880,7 @@ static val make_ffi_type_struct(val syntax, val lisp_type,
     memb[i].mtype = type;
     memb[i].mname = slot;
     memb[i].mtft = mtft;
+    memb[i].slidx = if3(slot, slot_index(lisp_type, slot), -1);
 
     if (bitfield_syntax_p(mtft->syntax)) {
       ucnum size = mtft->size;
@@ -5269,6 +5276,477 @@ val fill_carray(val carray, val offs, val stream)
   return ret;
 }
 
+enum carray_nk {
+  CA_NK_NONE, CA_NK_F64, CA_NK_I64, CA_NK_I32, CA_NK_U8
+};
+
+enum carray_op {
+  CA_OP_PLUS, CA_OP_MINUS, CA_OP_MUL,
+  CA_OP_LT, CA_OP_GT, CA_OP_LE, CA_OP_GE, CA_OP_EQ
+};
+
+struct carray_opnd {
+  mem_t *data;
+  int scalar;
+  union {
+    double f64;
+#if HAVE_I64
+    i64_t i64;
+#endif
+    long l;
+  } sc;
+};
+
+#define CARRAY_SUM_BLOCK (convert(cnum, 1) << 24)
+
+static enum carray_nk carray_num_kind(struct carray *scry)
+{
+  struct txr_ffi_type *etft = scry->eltft;
+
+  if (etft->get == ffi_double_get)
+    return CA_NK_F64;
+#if HAVE_I64
+  if (etft->get == ffi_i64_get ||
+      (etft->get == ffi_long_get && sizeof (long) == sizeof (i64_t)))
+    return CA_NK_I64;
+#endif
+#if HAVE_I32
+  if (etft->get == ffi_i32_get ||
+      (etft->get == ffi_int_get && sizeof (int) == sizeof (i32_t)))
+    return CA_NK_I32;
+#endif
+#if HAVE_I8
+  if (etft->get == ffi_u8_get || etft->get == ffi_uchar_get)
+    return CA_NK_U8;
+#endif
+  return CA_NK_NONE;
+}
+
+static struct carray *carray_num_checked(val carray, enum carray_nk *pnk,
+                                         val self)
+{
+  struct carray *scry = carray_struct_checked(carray);
+  enum carray_nk nk = carray_num_kind(scry);
+
+  if (nk == CA_NK_NONE)
+    uw_throwf(error_s, lit("~a: ~s doesn't have a numeric element type"),
+              self, carray, nao);
+  if (scry->nelem < 0)
+    uw_throwf(error_s, lit("~a: size of ~s array unknown"),
+              self, carray, nao);
+  if (coerce(uint_ptr_t, scry->data) % scry->eltft->align != 0)
+    uw_throwf(error_s, lit("~a: ~s has misaligned storage"),
+              self, carray, nao);
+
+  *pnk = nk;
+  return scry;
+}
+
+static val carray_num_prepare(val a, val b,
+                              struct carray_opnd *x, struct carray_opnd *y,
+                              enum carray_nk *pnk, cnum *pn, val self)
+{
+  enum carray_nk nk;
+  struct carray *scry;
+  struct carray_opnd *sop;
+  val num;
+
+  if (carrayp(a)) {
+    scry = carray_num_checked(a, &nk, self);
+    x->data = scry->data;
+    x->scalar = 0;
+
+    if (carrayp(b)) {
+      enum carray_nk bnk;
+      struct carray *sb = carray_num_checked(b, &bnk, self);
+      if (bnk != nk)
+        uw_throwf(error_s, lit("~a: element types of ~s and ~s differ"),
+                  self, a, b, nao);
+      if (sb->nelem != scry->nelem)
+        uw_throwf(error_s, lit("~a: lengths of ~s and ~s differ"),
+                  self, a, b, nao);
+      y->data = sb->data;
+      y->scalar = 0;
+      *pnk = nk;
+      *pn = scry->nelem;
+      return scry->eltype;
+    }
+
+    sop = y;
+    num = b;
+  } else {
+    scry = carray_num_checked(b, &nk, self);
+    y->data = scry->data;
+    y->scalar = 0;
+    sop = x;
+    num = a;
+  }
+
+  sop->data = coerce(mem_t *, &sop->sc);
+  sop->scalar = 1;
+  scry->eltft->put(scry->eltft, num, sop->data, self);
+
+  *pnk = nk;
+  *pn = scry->nelem;
+  return scry->eltype;
+}
+
+#define CARRAY_LOOP(T, R, EXPR)                                         \
+  do {                                                                  \
+    R *z = coerce(R *, zd);                                             \
+    const T *xv = coerce(const T *, x.data);                            \
+    const T *yv = coerce(const T *, y.data);                            \
+    cnum i;                                                             \
+    if (x.scalar) {                                                     \
+      T xi = xv[0];                                                     \
+      for (i = 0; i < n; i++) {                                         \
+        T yi = yv[i];                                                   \
+        z[i] = (EXPR);                                                  \
+      }                                                                 \
+    } else if (y.scalar) {                                              \
+      T yi = yv[0];                                                     \
+      for (i = 0; i < n; i++) {                                         \
+        T xi = xv[i];                                                   \
+        z[i] = (EXPR);                                                  \
+      }                                                                 \
+    } else {                                                            \
+      for (i = 0; i < n; i++) {                                         \
+        T xi = xv[i], yi = yv[i];                                       \
+        z[i] = (EXPR);                                                  \
+      }                                                                 \
+    }                                                                   \
+  } while (0)
+
+#define CARRAY_ARITH(T, UT)                                             \
+  switch (op) {                                                         \
+  case CA_OP_PLUS:                                                      \
+    CARRAY_LOOP(T, T, (T) ((UT) xi + (UT) yi));                         \
+    break;                                                              \
+  case CA_OP_MINUS:                                                     \
+    CARRAY_LOOP(T, T, (T) ((UT) xi - (UT) yi));                         \
+    break;                                                              \
+  case CA_OP_MUL:                                                       \
+    CARRAY_LOOP(T, T, (T) ((UT) xi * (UT) yi));                         \
+    break;                                                              \
+  case CA_OP_LT:                                                        \
+    CARRAY_LOOP(T, unsigned char, xi < yi);                             \
+    break;                                                              \
+  case CA_OP_GT:                                                        \
+    CARRAY_LOOP(T, unsigned char, xi > yi);                             \
+    break;                                                              \
+  case CA_OP_LE:                                                        \
+    CARRAY_LOOP(T, unsigned char, xi <= yi);                            \
+    break;                                                              \
+  case CA_OP_GE:                                                        \
+    CARRAY_LOOP(T, unsigned char, xi >= yi);                            \
+    break;                                                              \
+  case CA_OP_EQ:                                                        \
+    CARRAY_LOOP(T, unsigned char, xi == yi);                            \
+    break;                                                              \
+  }
+
+static val carray_binop(val a, val b, enum carray_op op, val self)
+{
+  struct carray_opnd x, y;
+  enum carray_nk nk;
+  cnum n;
+  val type = carray_num_prepare(a, b, &x, &y, &nk, &n, self);
+  val rtype = if3(op >= CA_OP_LT, ffi_type_compile(uchar_s), type);
+  val res = carray_blank(num(n), rtype);
+  mem_t *zd = carray_struct(res)->data;
+
+  switch (nk) {
+  case CA_NK_F64:
+    CARRAY_ARITH(double, double);
+    break;
+#if HAVE_I64
+  case CA_NK_I64:
+    CARRAY_ARITH(i64_t, u64_t);
+    break;
+#endif
+#if HAVE_I32
+  case CA_NK_I32:
+    CARRAY_ARITH(i32_t, u32_t);
+    break;
+#endif
+#if HAVE_I8
+  case CA_NK_U8:
+    CARRAY_ARITH(u8_t, unsigned);
+    break;
+#endif
+  default:
+    break;
+  }
+
+  gc_hint(a);
+  gc_hint(b);
+  return res;
+}
+
+val carray_plus(val a, val b)
+{
+  return carray_binop(a, b, CA_OP_PLUS, lit("+"));
+}
+
+val carray_minus(val a, val b)
+{
+  return carray_binop(a, b, CA_OP_MINUS, lit("-"));
+}
+
+val carray_mul(val a, val b)
+{
+  return carray_binop(a, b, CA_OP_MUL, lit("*"));
+}
+
+val carray_less(val a, val b)
+{
+  return carray_binop(a, b, CA_OP_LT, lit("carray-less"));
+}
+
+val carray_greater(val a, val b)
+{
+  return carray_binop(a, b, CA_OP_GT, lit("carray-greater"));
+}
+
+val carray_lequal(val a, val b)
+{
+  return carray_binop(a, b, CA_OP_LE, lit("carray-lequal"));
+}
+
+val carray_gequal(val a, val b)
+{
+  return carray_binop(a, b, CA_OP_GE, lit("carray-gequal"));
+}
+
+val carray_numeq(val a, val b)
+{
+  return carray_binop(a, b, CA_OP_EQ, lit("carray-numeq"));
+}
+
+#if HAVE_I64
+static i64_t carray_acc_i64(val *acc, i64_t s, i64_t x)
+{
+  i64_t t = convert(i64_t, convert(u64_t, s) + convert(u64_t, x));
+
+  if ((x < 0) != (t < s)) {
+    *acc = plus(*acc, num_i64(s));
+    return x;
+  }
+
+  return t;
+}
+#endif
+
+static double carray_sum_f64(const double *x, const double *y, cnum n)
+{
+  double s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+  cnum i;
+
+  if (y) {
+    for (i = 0; i + 4 <= n; i += 4) {
+      s0 += x[i] * y[i];
+      s1 += x[i + 1] * y[i + 1];
+      s2 += x[i + 2] * y[i + 2];
+      s3 += x[i + 3] * y[i + 3];
+    }
+    for (; i < n; i++)
+      s0 += x[i] * y[i];
+  } else {
+    for (i = 0; i + 4 <= n; i += 4) {
+      s0 += x[i];
+      s1 += x[i + 1];
+      s2 += x[i + 2];
+      s3 += x[i + 3];
+    }
+    for (; i < n; i++)
+      s0 += x[i];
+  }
+
+  return (s0 + s1) + (s2 + s3);
+}
+
+#define CARRAY_SUM_BLOCKED(T, EXPR)                                     \
+  do {                                                                  \
+    const T *xv = coerce(const T *, scry->data);                        \
+    const T *yv = coerce(const T *, ydata);                             \
+    cnum i = 0;                                                         \
+    (void) yv;                                                          \
+    while (i < n) {                                                     \
+      cnum lim = if3(n - i > CARRAY_SUM_BLOCK, i + CARRAY_SUM_BLOCK, n);  \
+      i64_t s = 0;                                                      \
+      for (; i < lim; i++)                                              \
+        s += (EXPR);                                                    \
+      ret = plus(ret, num_i64(s));                                      \
+    }                                                                   \
+  } while (0)
+
+val carray_sum(val carray)
+{
+  val self = lit("carray-sum");
+  enum carray_nk nk;
+  struct carray *scry = carray_num_checked(carray, &nk, self);
+  cnum n = scry->nelem;
+  mem_t *ydata = 0;
+  val ret = zero;
+
+  switch (nk) {
+  case CA_NK_F64:
+    ret = flo(carray_sum_f64(coerce(const double *, scry->data), 0, n));
+    break;
+#if HAVE_I64
+  case CA_NK_I64:
+    {
+      const i64_t *x = coerce(const i64_t *, scry->data);
+      i64_t s = 0;
+      cnum i;
+      for (i = 0; i < n; i++)
+        s = carray_acc_i64(&ret, s, x[i]);
+      ret = plus(ret, num_i64(s));
+    }
+    break;
+#endif
+#if HAVE_I32 && HAVE_I64
+  case CA_NK_I32:
+    CARRAY_SUM_BLOCKED(i32_t, xv[i]);
+    break;
+#endif
+#if HAVE_I8 && HAVE_I64
+  case CA_NK_U8:
+    CARRAY_SUM_BLOCKED(u8_t, xv[i]);
+    break;
+#endif
+  default:
+    break;
+  }
+
+  gc_hint(carray);
+  return ret;
+}
+
+val carray_dot(val a, val b)
+{
+  val self = lit("carray-dot");
+  enum carray_nk nk, bnk;
+  struct carray *scry = carray_num_checked(a, &nk, self);
+  struct carray *sb = carray_num_checked(b, &bnk, self);
+  cnum n = scry->nelem;
+  mem_t *ydata = sb->data;
+  val ret = zero;
+
+  if (bnk != nk)
+    uw_throwf(error_s, lit("~a: element types of ~s and ~s differ"),
+              self, a, b, nao);
+  if (sb->nelem != n)
+    uw_throwf(error_s, lit("~a: lengths of ~s and ~s differ"),
+              self, a, b, nao);
+
+  switch (nk) {
+  case CA_NK_F64:
+    ret = flo(carray_sum_f64(coerce(const double *, scry->data),
+                             coerce(const double *, ydata), n));
+    break;
+#if HAVE_I64
+  case CA_NK_I64:
+    {
+      const i64_t *x = coerce(const i64_t *, scry->data);
+      const i64_t *y = coerce(const i64_t *, ydata);
+      cnum i;
+      for (i = 0; i < n; i++)
+        ret = plus(ret, mul(num_i64(x[i]), num_i64(y[i])));
+    }
+    break;
+#endif
+#if HAVE_I32 && HAVE_I64
+  case CA_NK_I32:
+    {
+      const i32_t *x = coerce(const i32_t *, scry->data);
+      const i32_t *y = coerce(const i32_t *, ydata);
+      i64_t s = 0;
+      cnum i;
+      for (i = 0; i < n; i++)
+        s = carray_acc_i64(&ret, s, convert(i64_t, x[i]) * y[i]);
+      ret = plus(ret, num_i64(s));
+    }
+    break;
+#endif
+#if HAVE_I8 && HAVE_I64
+  case CA_NK_U8:
+    CARRAY_SUM_BLOCKED(u8_t, convert(i64_t, xv[i]) * yv[i]);
+    break;
+#endif
+  default:
+    break;
+  }
+
+  gc_hint(a);
+  gc_hint(b);
+  return ret;
+}
+
+#define CARRAY_MINMAX(T, BOX)                                           \
+  do {                                                                  \
+    const T *x = coerce(const T *, scry->data);                         \
+    T m = x[0];                                                         \
+    cnum i;                                                             \
+    if (want_max) {                                                     \
+      for (i = 1; i < n; i++)                                           \
+        if (x[i] > m)                                                   \
+          m = x[i];                                                     \
+    } else {                                                            \
+      for (i = 1; i < n; i++)                                           \
+        if (x[i] < m)                                                   \
+          m = x[i];                                                     \
+    }                                                                   \
+    ret = BOX(m);                                                       \
+  } while (0)
+
+static val carray_minmax(val carray, int want_max, val self)
+{
+  enum carray_nk nk;
+  struct carray *scry = carray_num_checked(carray, &nk, self);
+  cnum n = scry->nelem;
+  val ret = nil;
+
+  if (n == 0)
+    uw_throwf(error_s, lit("~a: ~s is empty"), self, carray, nao);
+
+  switch (nk) {
+  case CA_NK_F64:
+    CARRAY_MINMAX(double, flo);
+    break;
+#if HAVE_I64
+  case CA_NK_I64:
+    CARRAY_MINMAX(i64_t, num_i64);
+    break;
+#endif
+#if HAVE_I32
+  case CA_NK_I32:
+    CARRAY_MINMAX(i32_t, num);
+    break;
+#endif
+#if HAVE_I8
+  case CA_NK_U8:
+    CARRAY_MINMAX(u8_t, num_fast);
+    break;
+#endif
+  default:
+    break;
+  }
+
+  gc_hint(carray);
+  return ret;
+}
+
+val carray_min(val carray)
+{
+  return carray_minmax(carray, 0, lit("carray-min"));
+}
+
+val carray_max(val carray)
+{
+  return carray_minmax(carray, 1, lit("carray-max"));
+}
+
 struct uni {
   struct txr_ffi_type *tft;
   mem_t *data;
@@ -5598,6 +6076,15 @@ void ffi_init(void)
   reg_fun(intern(lit("num-carray"), user_package), func_n1(num_carray));
   reg_fun(intern(lit("put-carray"), user_package), func_n3o(put_carray, 1));
   reg_fun(intern(lit("fill-carray"), user_package), func_n3o(fill_carray, 1));
+  reg_fun(intern(lit("carray-sum"), user_package), func_n1(carray_sum));
+  reg_fun(intern(lit("carray-dot"), user_package), func_n2(carray_dot));
+  reg_fun(intern(lit("carray-min"), user_package), func_n1(carray_min));
+  reg_fun(intern(lit("carray-max"), user_package), func_n1(carray_max));
+  reg_fun(intern(lit("carray-less"), user_package), func_n2(carray_less));
+  reg_fun(intern(lit("carray-greater"), user_package), func_n2(carray_greater));
+  reg_fun(intern(lit("carray-lequal"), user_package), func_n2(carray_lequal));
+  reg_fun(intern(lit("carray-gequal"), user_package), func_n2(carray_gequal));
+  reg_fun(intern(lit("carray-numeq"), user_package), func_n2(carray_numeq));
   reg_fun(intern(lit("make-union"), user_package), func_n3o(make_union, 1));
   reg_fun(intern(lit("union-members"), user_package), func_n1(union_members));
   reg_fun(intern(lit("union-get"), user_package), func_n2(union_get));
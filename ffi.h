@@ -123,6 +123,18 @@ val unum_carray(val carray);
 val num_carray(val carray);
 val put_carray(val carray, val offs, val stream);
 val fill_carray(val carray, val offs, val stream);
+val carray_plus(val a, val b);
+val carray_minus(val a, val b);
+val carray_mul(val a, val b);
+val carray_less(val a, val b);
+val carray_greater(val a, val b);
+val carray_lequal(val a, val b);
+val carray_gequal(val a, val b);
+val carray_numeq(val a, val b);
+val carray_sum(val carray);
+val carray_dot(val a, val b);
+val carray_min(val carray);
+val carray_max(val carray);
 mem_t *union_get_ptr(val uni);
 val make_union(val type, val init, val memb);
 val union_members(val uni);
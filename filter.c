@@ -251,21 +251,30 @@ static val build_filter_from_list(val list)
   return trie;
 }
 
+static void string_extend_wcs(val out, const wchar_t *src, cnum n)
+{
+  if (n > 0) {
+    cnum len = c_num(length_str(out));
+    string_extend(out, num(n));
+    wmemcpy(out->st.str + len, src, n);
+    out->st.str[len + n] = 0;
+  }
+}
+
 static val trie_filter_string(val filter, val str)
 {
-  val len = length_str(str);
-  val i;
-  val out = string(L"");
+  const wchar_t *cstr = c_str(str);
+  cnum len = c_num(length_str(str));
+  cnum i, run;
+  val out = mkustring(zero);
 
-  for (i = zero; lt(i, len); ) {
+  for (i = run = 0; i < len; ) {
     val node = trie_lookup_begin(filter);
-    val match = nil;
     val subst = nil;
-    val j;
+    cnum j, match = -1;
 
-    for (j = i; lt(j, len); j = plus(j, one)) {
-      val ch = chr_str(str, j);
-      val nnode = trie_lookup_feed_char(node, ch);
+    for (j = i; j < len; j++) {
+      val nnode = trie_lookup_feed_char(node, chr(cstr[j]));
       val nsubst;
 
       if (!nnode)
@@ -279,15 +288,16 @@ static val trie_filter_string(val filter, val str)
       node = nnode;
     }
 
-    if (match) {
+    if (match >= 0) {
+      string_extend_wcs(out, cstr + run, i - run);
       string_extend(out, subst);
-      i = plus(match, one);
+      i = run = match + 1;
     } else {
-      string_extend(out, chr_str(str, i));
-      i = plus(i, one);
+      i++;
     }
   }
 
+  string_extend_wcs(out, cstr + run, len - run);
   return out;
 }
 
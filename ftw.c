@@ -30,8 +30,18 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
 #include <ftw.h>
 #include "config.h"
+#if HAVE_PTHREAD
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#endif
+#if HAVE_FNMATCH
+#include <fnmatch.h>
+#endif
 #include ALLOCA_H
 #include "lib.h"
 #include "gc.h"
@@ -41,6 +51,7 @@
 #include "signal.h"
 #include "unwind.h"
 #include "sysif.h"
+#include "arith.h"
 #include "ftw.h"
 
 static val s_callback;
@@ -127,6 +138,493 @@ val ftw_wrap(val dirpath, val fn, val flags_in, val nopenfd_in)
   }
 }
 
+#if HAVE_PTHREAD
+
+/*
+ * Parallel walk: worker threads take directories from a shared stack,
+ * read them and stat their entries, pushing subdirectories back onto
+ * the stack. Entries whose names pass the fnmatch pattern are gathered
+ * into batches which are queued for the main thread, which turns each
+ * batch into a vector and passes it to the Lisp callback. The workers
+ * touch no Lisp objects; all their memory is plain malloc.
+ */
+
+struct walk_dir {
+  struct walk_dir *next;
+  char *path;
+  struct stat st;
+  int report;
+};
+
+struct walk_ent {
+  char *path;
+  int type;
+  struct stat st;
+};
+
+struct walk_batch {
+  struct walk_batch *next;
+  size_t n;
+  struct walk_ent ent[1];
+};
+
+struct walk {
+  pthread_mutex_t mtx;
+  pthread_cond_t work_cnd, out_cnd;
+  struct walk_dir *dirs;
+  struct walk_batch *out, **out_tail;
+  int nout, maxout;
+  int active, nexit, nthreads, stop;
+  const char *pattern;
+  size_t batch_size;
+};
+
+static int walk_match(struct walk *w, const char *path)
+{
+  const char *base = strrchr(path, '/');
+
+  if (w->pattern == 0)
+    return 1;
+
+  base = if3(base && base[1], base + 1, path);
+#if HAVE_FNMATCH
+  return fnmatch(w->pattern, base, 0) == 0;
+#else
+  return 1;
+#endif
+}
+
+static struct walk_batch *walk_batch_new(struct walk *w)
+{
+  struct walk_batch *b = coerce(struct walk_batch *,
+                                malloc(offsetof(struct walk_batch, ent) +
+                                       w->batch_size * sizeof b->ent[0]));
+  if (b) {
+    b->next = 0;
+    b->n = 0;
+  }
+  return b;
+}
+
+static void walk_batch_free(struct walk_batch *b)
+{
+  size_t i;
+  for (i = 0; i < b->n; i++)
+    free(b->ent[i].path);
+  free(b);
+}
+
+static int walk_publish(struct walk *w, struct walk_batch *b)
+{
+  int stop;
+
+  pthread_mutex_lock(&w->mtx);
+  while (!w->stop && w->nout >= w->maxout)
+    pthread_cond_wait(&w->out_cnd, &w->mtx);
+  if (!(stop = w->stop)) {
+    *w->out_tail = b;
+    w->out_tail = &b->next;
+    w->nout++;
+    pthread_cond_broadcast(&w->out_cnd);
+  }
+  pthread_mutex_unlock(&w->mtx);
+
+  if (stop)
+    walk_batch_free(b);
+  return !stop;
+}
+
+/*
+ * Add an entry to the worker's current batch, publishing the batch
+ * when it fills up. Takes ownership of path.
+ */
+static int walk_add(struct walk *w, struct walk_batch **pb, char *path,
+                    int type, const struct stat *st)
+{
+  struct walk_batch *b = *pb;
+  struct walk_ent *e;
+
+  if (b == 0 && (b = *pb = walk_batch_new(w)) == 0) {
+    free(path);
+    return 1;
+  }
+
+  e = &b->ent[b->n++];
+  e->path = path;
+  e->type = type;
+  if (st)
+    e->st = *st;
+  else
+    memset(&e->st, 0, sizeof e->st);
+
+  if (b->n == w->batch_size) {
+    *pb = 0;
+    return walk_publish(w, b);
+  }
+
+  return 1;
+}
+
+static char *walk_path(const char *dir, const char *name)
+{
+  size_t dl = strlen(dir), nl = strlen(name);
+  int slash = (dl > 0 && dir[dl - 1] != '/');
+  char *path = coerce(char *, malloc(dl + slash + nl + 1));
+
+  if (path) {
+    memcpy(path, dir, dl);
+    if (slash)
+      path[dl] = '/';
+    memcpy(path + dl + slash, name, nl + 1);
+  }
+
+  return path;
+}
+
+static int walk_one_dir(struct walk *w, struct walk_dir *wd,
+                        struct walk_batch **pb)
+{
+  DIR *d = opendir(wd->path);
+  struct walk_dir *subdirs = 0, **subtail = &subdirs;
+  struct dirent *de;
+  int ok = 1;
+
+  if (wd->report) {
+    char *path = strdup(wd->path);
+    if (path)
+      ok = walk_add(w, pb, path, if3(d, FTW_D, FTW_DNR), &wd->st);
+  }
+
+  if (d == 0)
+    return ok;
+
+  while (ok && (de = readdir(d)) != 0) {
+    const char *name = de->d_name;
+    struct stat st;
+    char *path;
+    int match, isdir, type;
+
+    if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0)))
+      continue;
+
+    if ((path = walk_path(wd->path, name)) == 0)
+      continue;
+
+    match = walk_match(w, path);
+
+#ifdef DT_DIR
+    if (!match && de->d_type != DT_DIR && de->d_type != DT_UNKNOWN) {
+      free(path);
+      continue;
+    }
+#endif
+
+#if defined AT_SYMLINK_NOFOLLOW
+    if (fstatat(dirfd(d), name, &st, AT_SYMLINK_NOFOLLOW) < 0)
+#else
+    if (lstat(path, &st) < 0)
+#endif
+    {
+      if (match)
+        ok = walk_add(w, pb, path, FTW_NS, 0);
+      else
+        free(path);
+      continue;
+    }
+
+    isdir = S_ISDIR(st.st_mode);
+
+    if (isdir) {
+      struct walk_dir *sub = coerce(struct walk_dir *, malloc(sizeof *sub));
+      if (sub) {
+        sub->next = 0;
+        sub->path = path;
+        sub->st = st;
+        sub->report = match;
+        *subtail = sub;
+        subtail = &sub->next;
+      } else {
+        free(path);
+      }
+      continue;
+    }
+
+    if (!match) {
+      free(path);
+      continue;
+    }
+
+    type = if3(S_ISLNK(st.st_mode), FTW_SL, FTW_F);
+    ok = walk_add(w, pb, path, type, &st);
+  }
+
+  closedir(d);
+
+  if (subdirs) {
+    pthread_mutex_lock(&w->mtx);
+    *subtail = w->dirs;
+    w->dirs = subdirs;
+    pthread_cond_broadcast(&w->work_cnd);
+    pthread_mutex_unlock(&w->mtx);
+  }
+
+  return ok;
+}
+
+static void *walk_worker(void *arg)
+{
+  struct walk *w = coerce(struct walk *, arg);
+  struct walk_batch *b = 0;
+
+  for (;;) {
+    struct walk_dir *wd;
+
+    pthread_mutex_lock(&w->mtx);
+    while (!w->stop && w->dirs == 0 && w->active > 0)
+      pthread_cond_wait(&w->work_cnd, &w->mtx);
+    if (w->stop || w->dirs == 0) {
+      pthread_cond_broadcast(&w->work_cnd);
+      pthread_mutex_unlock(&w->mtx);
+      break;
+    }
+    wd = w->dirs;
+    w->dirs = wd->next;
+    w->active++;
+    pthread_mutex_unlock(&w->mtx);
+
+    walk_one_dir(w, wd, &b);
+    free(wd->path);
+    free(wd);
+
+    pthread_mutex_lock(&w->mtx);
+    if (--w->active == 0 && w->dirs == 0)
+      pthread_cond_broadcast(&w->work_cnd);
+    pthread_mutex_unlock(&w->mtx);
+  }
+
+  if (b != 0 && b->n > 0)
+    walk_publish(w, b);
+  else
+    free(b);
+
+  pthread_mutex_lock(&w->mtx);
+  w->nexit++;
+  pthread_cond_broadcast(&w->out_cnd);
+  pthread_mutex_unlock(&w->mtx);
+  return 0;
+}
+
+/*
+ * Roots which are not directories are reported by the main thread
+ * before the workers start; the batch goes straight onto the output
+ * queue, bypassing its bound. Takes ownership of path.
+ */
+static void walk_root(struct walk *w, struct walk_batch **pb, char *path,
+                      int type, const struct stat *st)
+{
+  struct walk_batch *b = *pb;
+  struct walk_ent *e;
+
+  if (b == 0 || b->n == w->batch_size) {
+    if ((b = walk_batch_new(w)) == 0) {
+      free(path);
+      return;
+    }
+    *w->out_tail = b;
+    w->out_tail = &b->next;
+    w->nout++;
+    *pb = b;
+  }
+
+  e = &b->ent[b->n++];
+  e->path = path;
+  e->type = type;
+  e->st = *st;
+}
+
+static val walk_batch_vec(struct walk_batch *b)
+{
+  list_collect_decl (out, ptail);
+  size_t i;
+
+  for (i = 0; i < b->n; i++) {
+    struct walk_ent *e = &b->ent[i];
+    ptail = list_collect(ptail, vec(string_utf8(e->path), num(e->type),
+                                    num(e->st.st_size), num(e->st.st_mtime),
+                                    unum(e->st.st_ino), nao));
+  }
+
+  return vec_list(out);
+}
+
+static struct walk_batch *walk_next(struct walk *w)
+{
+  struct walk_batch *b;
+
+  pthread_mutex_lock(&w->mtx);
+  while (w->out == 0 && w->nexit < w->nthreads)
+    pthread_cond_wait(&w->out_cnd, &w->mtx);
+  if ((b = w->out) != 0) {
+    if ((w->out = b->next) == 0)
+      w->out_tail = &w->out;
+    w->nout--;
+    pthread_cond_broadcast(&w->out_cnd);
+  }
+  pthread_mutex_unlock(&w->mtx);
+
+  return b;
+}
+
+val ftw_batch(val dirpath, val fn, val pattern_in, val nthreads_in,
+              val batch_size_in)
+{
+  val self = lit("ftw-batch");
+  val pattern = default_null_arg(pattern_in);
+  cnum nthreads = c_num(default_arg(nthreads_in, num_fast(8)));
+  cnum batch_size = c_num(default_arg(batch_size_in, num_fast(1024)));
+  struct walk w;
+  pthread_t *volatile tids = 0;
+  char *volatile pattern_u8 = 0;
+  struct walk_batch *volatile cur = 0;
+  struct walk_batch *rb = 0;
+  volatile int nstarted = 0;
+  val paths = if3(listp(dirpath), dirpath, cons(dirpath, nil));
+  val ret = nil;
+
+  if (nthreads < 1 || nthreads > 256)
+    uw_throwf(error_s, lit("~a: thread count ~s out of range"),
+              self, nthreads_in, nao);
+
+  if (batch_size < 1 || batch_size > 1048576)
+    uw_throwf(error_s, lit("~a: batch size ~s out of range"),
+              self, batch_size_in, nao);
+
+#if !HAVE_FNMATCH
+  if (pattern)
+    uw_throwf(error_s, lit("~a: pattern matching not supported"), self, nao);
+#endif
+
+  memset(&w, 0, sizeof w);
+  w.out_tail = &w.out;
+  w.nthreads = nthreads;
+  w.maxout = 4 * nthreads;
+  w.batch_size = batch_size;
+
+  uw_simple_catch_begin;
+
+  if (pattern)
+    w.pattern = pattern_u8 = utf8_dup_to(c_str(pattern));
+
+  for (; paths; paths = cdr(paths)) {
+    char *path = utf8_dup_to(c_str(car(paths)));
+    struct stat st;
+
+    if (lstat(path, &st) != 0) {
+      free(path);
+      continue;
+    }
+
+    ret = t;
+
+    if (S_ISDIR(st.st_mode)) {
+      struct walk_dir *wd = coerce(struct walk_dir *, chk_malloc(sizeof *wd));
+      wd->path = path;
+      wd->st = st;
+      wd->report = walk_match(&w, path);
+      wd->next = w.dirs;
+      w.dirs = wd;
+    } else if (walk_match(&w, path)) {
+      walk_root(&w, &rb, path, if3(S_ISLNK(st.st_mode), FTW_SL, FTW_F),
+                &st);
+    } else {
+      free(path);
+    }
+  }
+
+  pthread_mutex_init(&w.mtx, 0);
+  pthread_cond_init(&w.work_cnd, 0);
+  pthread_cond_init(&w.out_cnd, 0);
+
+  tids = coerce(pthread_t *, chk_xalloc(nthreads, sizeof *tids, self));
+
+  {
+    sigset_t all, saved;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &saved);
+    for (; nstarted < nthreads; nstarted++)
+      if (pthread_create(&tids[nstarted], 0, walk_worker, &w) != 0)
+        break;
+    pthread_sigmask(SIG_SETMASK, &saved, 0);
+  }
+
+  if (nstarted == 0)
+    uw_throwf(error_s, lit("~a: unable to create threads"), self, nao);
+
+  pthread_mutex_lock(&w.mtx);
+  w.nthreads = nstarted;
+  pthread_mutex_unlock(&w.mtx);
+
+  while ((cur = walk_next(&w)) != 0) {
+    val vec = walk_batch_vec(cur);
+    uw_frame_t cont_guard;
+
+    walk_batch_free(cur);
+    cur = 0;
+
+    sig_check_fast();
+
+    uw_push_guard(&cont_guard, 1);
+    funcall1(fn, vec);
+    uw_pop_frame(&cont_guard);
+  }
+
+  uw_unwind {
+    int i;
+
+    if (nstarted > 0) {
+      pthread_mutex_lock(&w.mtx);
+      w.stop = 1;
+      pthread_cond_broadcast(&w.work_cnd);
+      pthread_cond_broadcast(&w.out_cnd);
+      pthread_mutex_unlock(&w.mtx);
+
+      for (i = 0; i < nstarted; i++)
+        pthread_join(tids[i], 0);
+    }
+
+    if (tids != 0) {
+      pthread_mutex_destroy(&w.mtx);
+      pthread_cond_destroy(&w.work_cnd);
+      pthread_cond_destroy(&w.out_cnd);
+    }
+
+    if (cur != 0)
+      walk_batch_free(cur);
+
+    while (w.out != 0) {
+      struct walk_batch *b = w.out;
+      w.out = b->next;
+      walk_batch_free(b);
+    }
+
+    while (w.dirs != 0) {
+      struct walk_dir *wd = w.dirs;
+      w.dirs = wd->next;
+      free(wd->path);
+      free(wd);
+    }
+
+    free(tids);
+    free(pattern_u8);
+  }
+
+  uw_catch_end;
+
+  return ret;
+}
+
+#endif
+
 void ftw_init(void)
 {
   prot1(&s_callback);
@@ -186,4 +684,7 @@ void ftw_init(void)
 #endif
 
   reg_fun(intern(lit("ftw"), user_package), func_n4o(ftw_wrap, 2));
+#if HAVE_PTHREAD
+  reg_fun(intern(lit("ftw-batch"), user_package), func_n5o(ftw_batch, 2));
+#endif
 }
@@ -26,5 +26,8 @@
  */
 
 val ftw_wrap(val dirpath, val fn, val nopenfd, val flags);
+#if HAVE_PTHREAD
+val ftw_batch(val dirpath, val fn, val pattern, val nthreads, val batch_size);
+#endif
 void ftw_init(void);
 
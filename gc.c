@@ -68,6 +68,7 @@ int opt_gc_debug;
 int opt_vg_debug;
 #endif
 static val *gc_stack_bottom;
+static struct gc_stack *gc_stacks;
 
 static val *prot_stack[PROT_STACK_SIZE];
 static val **prot_stack_limit = prot_stack + PROT_STACK_SIZE;
@@ -497,9 +498,19 @@ static void mark(mach_context_t *pmc, val *gc_stack_top)
   mark_mem_region(coerce(val *, pmc), coerce(val *, (pmc + 1)));
 
   /*
-   * Finally, the stack.
+   * Finally, the stack, and the suspended stacks beneath it
+   * (the callers of coroutines which are currently running).
    */
   mark_mem_region(gc_stack_top, gc_stack_bottom);
+
+  {
+    struct gc_stack *st;
+
+    for (st = gc_stacks; st; st = st->next) {
+      mark_mem_region(coerce(val *, st->ctx), coerce(val *, st->ctx + 1));
+      mark_mem_region(st->top, st->bottom);
+    }
+  }
 }
 
 static int sweep_one(obj_t *block)
@@ -787,6 +798,24 @@ void gc_init(val *stack_bottom)
   gc_stack_bottom = stack_bottom;
 }
 
+void gc_push_stack(struct gc_stack *st, val *top, struct jmp *ctx,
+                   val *new_bottom)
+{
+  st->top = top;
+  st->bottom = gc_stack_bottom;
+  st->ctx = ctx;
+  st->next = gc_stacks;
+  gc_stacks = st;
+  gc_stack_bottom = new_bottom;
+}
+
+void gc_pop_stack(struct gc_stack *st)
+{
+  assert (gc_stacks == st);
+  gc_stacks = st->next;
+  gc_stack_bottom = st->bottom;
+}
+
 void gc_mark(val obj)
 {
   mark_obj(obj);
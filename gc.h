@@ -38,6 +38,19 @@ void gc_conservative_mark(val);
 void gc_mark_mem(val *low, val *high);
 int gc_is_reachable(val);
 val gc_finalize(val obj, val fun, val rev_order_p);
+
+struct jmp;
+
+struct gc_stack {
+  val *top;
+  val *bottom;
+  struct jmp *ctx;
+  struct gc_stack *next;
+};
+
+void gc_push_stack(struct gc_stack *, val *top, struct jmp *ctx,
+                   val *new_bottom);
+void gc_pop_stack(struct gc_stack *);
 val gc_call_finalizers(val obj);
 
 #if CONFIG_GEN_GC
@@ -36,6 +36,7 @@
 #include <errno.h>
 #include <wchar.h>
 #include <math.h>
+#include <float.h>
 #include <time.h>
 #include <signal.h>
 #include <sys/time.h>
@@ -4056,6 +4057,25 @@ val scat(val sep, ...)
   return ret;
 }
 
+/*
+ * Like sub_str, for a string which is not lazy, and a range whose bounds
+ * are known to be in order and in range. A nil value of to denotes
+ * the end of the string.
+ */
+static val sub_str_fast(val str, val from, val to)
+{
+  if (!to)
+    to = length_str(str);
+
+  if (from == to) {
+    return null_string;
+  } else {
+    val piece = mkustring(minus(to, from));
+    init_str(piece, c_str(str) + c_num(from));
+    return piece;
+  }
+}
+
 val split_str_keep(val str, val sep, val keep_sep)
 {
   keep_sep = default_null_arg(keep_sep);
@@ -4064,6 +4084,7 @@ val split_str_keep(val str, val sep, val keep_sep)
     list_collect_decl (out, iter);
     val pos = zero;
     val slen = length(str);
+    val (*sub)(val, val, val) = if3(lazy_stringp(str), sub_str, sub_str_fast);
 
     for (;;) {
       cons_bind (new_pos, len, search_regex(str, sep, pos, nil));
@@ -4071,13 +4092,13 @@ val split_str_keep(val str, val sep, val keep_sep)
       if (len == zero && new_pos != slen)
         new_pos = plus(new_pos, one);
 
-      iter = list_collect(iter, sub_str(str, pos, new_pos));
+      iter = list_collect(iter, sub(str, pos, new_pos));
       pos = new_pos;
 
       if (len && pos != slen) {
         pos = plus(pos, len);
         if (keep_sep)
-          iter = list_collect(iter, sub_str(str, new_pos, pos));
+          iter = list_collect(iter, sub(str, new_pos, pos));
         continue;
       }
       break;
@@ -4118,7 +4139,9 @@ val split_str_keep(val str, val sep, val keep_sep)
       list_collect_decl (out, iter);
 
       for (;;) {
-        const wchar_t *psep = wcsstr(cstr, csep);
+        const wchar_t *psep = if3(len_sep == 1,
+                                  wcschr(cstr, *csep),
+                                  wcsstr(cstr, csep));
         size_t span = (psep != 0) ? psep - cstr : wcslen(cstr);
         val piece = mkustring(num(span));
         init_str(piece, cstr);
@@ -4178,6 +4201,7 @@ val tok_str(val str, val tok_regex, val keep_sep)
   val last_end = zero;
   val slen = length(str);
   int prev_empty = 1;
+  val (*sub)(val, val, val) = if3(lazy_stringp(str), sub_str, sub_str_fast);
 
   keep_sep = default_null_arg(keep_sep);
 
@@ -4189,29 +4213,29 @@ val tok_str(val str, val tok_regex, val keep_sep)
 
     if (new_pos == slen || !len) {
       if (keep_sep)
-        iter = list_collect(iter, sub_str(str, pos, t));
+        iter = list_collect(iter, sub(str, pos, slen));
       break;
     }
 
     if (keep_sep)
-      iter = list_collect(iter, sub_str(str, pos, new_pos));
+      iter = list_collect(iter, sub(str, pos, new_pos));
 
     pos = plus(new_pos, len);
-    iter = list_collect(iter, sub_str(str, new_pos, pos));
+    iter = list_collect(iter, sub(str, new_pos, pos));
   } else for (;;) {
     cons_bind (new_pos, len, search_regex(str, tok_regex, pos, nil));
 
     if (!len || (new_pos == slen && !prev_empty)) {
       if (keep_sep)
-        iter = list_collect(iter, sub_str(str, last_end, t));
+        iter = list_collect(iter, sub(str, last_end, slen));
       break;
     }
 
     if (len != zero || prev_empty) {
       if (keep_sep)
-        iter = list_collect(iter, sub_str(str, last_end, new_pos));
+        iter = list_collect(iter, sub(str, last_end, new_pos));
       last_end = plus(new_pos, len);
-      iter = list_collect(iter, sub_str(str, new_pos, last_end));
+      iter = list_collect(iter, sub(str, new_pos, last_end));
       prev_empty = (len == zero);
     } else {
       prev_empty = 1;
@@ -4383,117 +4407,299 @@ val str_ge(val astr, val bstr)
   return if2(cmp == zero || cmp == one, t);
 }
 
-val int_str(val str, val base)
+/*
+ * The numeric parsers work on the range [wcs, end). A null end
+ * means the range extends to the terminating null character,
+ * which no digit or other syntax element matches.
+ */
+static const wchar_t *num_range(val str, val start, val end,
+                                 const wchar_t **pend)
 {
   const wchar_t *wcs = c_str(str);
-  wchar_t *ptr;
-  long value;
-  cnum b = c_num(default_arg(base, num_fast(10)));
-  int zerox = 0, octzero = 0, minus = 0, flip = 0;
+  cnum len, from, to;
 
-  switch (wcs[0]) {
-  case '-':
-    minus = 1;
-    /* fallthrough */
-  case '+':
-    switch (wcs[1]) {
-    case '0':
-      switch (wcs[2]) {
-      case 'x': case 'X':
-        zerox = 1;
-        wcs += 3;
-        flip = minus;
-        break;
-      default:
-        octzero = 1;
-        break;
-      }
-    }
-    break;
-  case '0':
-    switch (wcs[1]) {
-    case 'x': case 'X':
-      zerox = 1;
-      wcs += 2;
-    default:
-      octzero = 1;
-    }
-    break;
+  if (null_or_missing_p(start) && null_or_missing_p(end)) {
+    *pend = 0;
+    return wcs;
   }
 
+  len = c_num(length_str(str));
+  from = if3(null_or_missing_p(start), 0, c_num(start));
+  to = if3(null_or_missing_p(end), len, c_num(end));
+
+  if (from < 0)
+    from += len;
+  if (to < 0)
+    to += len;
+
+  from = if3(from < 0, 0, if3(from > len, len, from));
+  to = if3(to < from, from, if3(to > len, len, to));
+
+  *pend = wcs + to;
+  return wcs + from;
+}
+
+INLINE int digit_value(wchar_t ch)
+{
+  if (ch >= '0' && ch <= '9')
+    return ch - '0';
+  if (ch >= 'a' && ch <= 'z')
+    return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'Z')
+    return ch - 'A' + 10;
+  return 36;
+}
+
+/*
+ * Digits are accumulated in a ucnum until it is about to overflow,
+ * after which the bignum is built directly, a machine word's worth
+ * of digits at a time.
+ */
+static val int_wcs(const wchar_t *wcs, const wchar_t *end, val base)
+{
+  const wchar_t *p = wcs, *dig;
+  cnum b = c_num(default_arg(base, num_fast(10)));
+  int minus = 0, d;
+  ucnum acc = 0, limit;
+  val bignum;
+
+  while (p != end && iswspace(*p))
+    p++;
+
+  if (p != end && (*p == '-' || *p == '+'))
+    minus = (*p++ == '-');
+
   if (base == chr('c')) {
-    b = (zerox ? 16 : (octzero ? 8 : 10));
-  } else if (b == 16) {
-    /* If base is 16, strtoul and its siblings
-       still recognize the 0x prefix. We don't want that;
-       except if base is the character #\c. Otherwise,
-       it is a zero with trailing junk. */
-    if (zerox)
-      return zero;
+    if (p != end && *p == '0') {
+      if (p + 1 != end && (p[1] == 'x' || p[1] == 'X')) {
+        b = 16;
+        p += 2;
+      } else {
+        b = 8;
+      }
+    } else {
+      b = 10;
+    }
   } else if (b < 2 || b > 36) {
      uw_throwf(error_s, lit("int-str: invalid base ~s"), base, nao);
   }
 
-  /* TODO: detect if we have wcstoll */
-  value = wcstol(wcs, &ptr, b);
+  limit = (convert(ucnum, -1) - (b - 1)) / b;
+
+  for (dig = p; p != end && (d = digit_value(*p)) < b; p++) {
+    if (acc > limit)
+      goto big;
+    acc = acc * b + d;
+  }
 
-  if (value == 0 && ptr == wcs)
+  if (p == dig)
     return nil;
 
-  if ((value == LONG_MAX || value == LONG_MIN) && errno == ERANGE) {
-    val bignum = make_bignum();
-    size_t size;
-    unsigned char *ucs = utf8_dup_to_buf(wcs, &size, 1);
-    mp_err err = mp_read_radix(mp(bignum), ucs, b);
+  if (acc <= NUM_MAX)
+    return num_fast(if3(minus, -convert(cnum, acc), convert(cnum, acc)));
 
-    free(ucs); /* TODO: make wchar_t version of mp_read_radix. */
-    gc_hint(str);
+  bignum = bignum_from_uintptr(acc);
 
-    if (err != MP_OKAY)
-      return nil;
+  if (minus)
+    mp_neg(mp(bignum), mp(bignum));
+
+  return normalize(bignum);
+
+big:
+  bignum = bignum_from_uintptr(acc);
 
-    if (flip)
-      mp_neg(mp(bignum), mp(bignum));
-    /* If wcstol overflowed, but the range of long is smaller than
-       that of fixnums, that means that the value might not
-       actually be a bignum, and so we must normalize.
-       We do not need this on our usual target platforms, where NUM_MAX is
-       never larger than LONG_MAX. */
-    return (LONG_MAX < NUM_MAX) ? normalize(bignum) : bignum;
+  {
+    mp_digit mlimit = (MP_DIGIT_MAX - (b - 1)) / b;
+
+    while (p != end && (d = digit_value(*p)) < b) {
+      mp_digit chunk = 0, mul = 1;
+      mp_err mpe;
+
+      for (; p != end && mul <= mlimit && (d = digit_value(*p)) < b; p++) {
+        chunk = chunk * b + d;
+        mul *= b;
+      }
+
+      if ((mpe = mp_mul_d(mp(bignum), mul, mp(bignum))) != MP_OKAY ||
+          (mpe = mp_add_d(mp(bignum), chunk, mp(bignum))) != MP_OKAY)
+        do_mp_error(lit("int-str"), mpe);
+    }
   }
 
-  if (flip)
-    value = -value;
+  if (minus)
+    mp_neg(mp(bignum), mp(bignum));
 
-  if (value >= NUM_MIN && value <= NUM_MAX)
-    return num(value);
+  return bignum;
+}
 
-  return bignum_from_long(value);
+val int_str(val str, val base)
+{
+  return int_substr(str, base, nil, nil);
 }
 
-val flo_str(val str)
+val int_substr(val str, val base, val start, val end)
 {
-  const wchar_t *wcs = c_str(str);
-  wchar_t *ptr;
+  const wchar_t *e, *wcs = num_range(str, start, end, &e);
+  val ret = int_wcs(wcs, e, base);
+  gc_hint(str);
+  return ret;
+}
+
+/*
+ * When the decimal significand fits into 53 bits and the power of ten
+ * is exactly representable, a single multiplication or division gives
+ * the correctly rounded result (Clinger's fast path). Other inputs
+ * go to wcstod.
+ */
+#if FLT_RADIX == 2 && DBL_MANT_DIG == 53 && \
+    defined __FLT_EVAL_METHOD__ && __FLT_EVAL_METHOD__ == 0
+#define HAVE_FAST_FLO 1
+
+static const double flo_pow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+#define FLO_SIG_MAX (if3(sizeof (ucnum) >= 8, 19, 9))
+#endif
+
+static val flo_wcs(const wchar_t *wcs, const wchar_t *end)
+{
+  double value;
+  wchar_t *ptr, *copy = 0;
+  int none;
+
+#if HAVE_FAST_FLO
+  {
+    const wchar_t *p = wcs;
+    int minus = 0, ndig = 0, nsig = 0;
+    cnum e10 = 0;
+    ucnum m = 0;
+    unsigned d;
+
+    while (p != end && iswspace(*p))
+      p++;
+
+    if (p != end && (*p == '-' || *p == '+'))
+      minus = (*p++ == '-');
+
+    if (p != end && *p == '0' && p + 1 != end && (p[1] == 'x' || p[1] == 'X'))
+      goto slow;
+
+    for (; p != end && (d = *p - '0') < 10; p++, ndig++) {
+      if (m == 0 && d == 0)
+        continue;
+      if (nsig++ == FLO_SIG_MAX)
+        goto slow;
+      m = m * 10 + d;
+    }
+
+    if (p != end && *p == '.') {
+      for (p++; p != end && (d = *p - '0') < 10; p++, ndig++, e10--) {
+        if (m == 0 && d == 0)
+          continue;
+        if (nsig++ == FLO_SIG_MAX)
+          goto slow;
+        m = m * 10 + d;
+      }
+    }
+
+    if (ndig == 0)
+      goto slow;
+
+    if (p != end && (*p == 'e' || *p == 'E')) {
+      const wchar_t *q = p + 1, *edig;
+      int eminus = 0;
+      cnum exp = 0;
+
+      if (q != end && (*q == '-' || *q == '+'))
+        eminus = (*q++ == '-');
+
+      for (edig = q; q != end && (d = *q - '0') < 10; q++)
+        if (exp < 100000)
+          exp = exp * 10 + d;
+
+      if (q != edig)
+        e10 += if3(eminus, -exp, exp);
+    }
+
+    if (m == 0)
+      return flo(if3(minus, -0.0, 0.0));
+
+    if (e10 > 22 && e10 - 22 + nsig <= 15) {
+      for (; e10 > 22; e10--)
+        m *= 10;
+    }
+
+    /* m must be below 2^53; the split shift is for 32-bit ucnum */
+    if (e10 < -22 || e10 > 22 || (m >> 26 >> 27) != 0)
+      goto slow;
+
+    value = convert(double, m);
+    value = if3(e10 < 0, value / flo_pow10[-e10], value * flo_pow10[e10]);
+    return flo(if3(minus, -value, value));
+  }
+slow:
+#endif
 
-  /* TODO: detect if we have wcstod */
-  double value = wcstod(wcs, &ptr);
-  if (value == 0 && ptr == wcs)
+  if (end != 0) {
+    size_t n = end - wcs;
+    copy = chk_wmalloc(n + 1);
+    wmemcpy(copy, wcs, n);
+    copy[n] = 0;
+    wcs = copy;
+  }
+
+  errno = 0;
+  value = wcstod(wcs, &ptr);
+  none = (ptr == wcs);
+  free(copy);
+
+  if (value == 0 && none)
     return nil;
   if ((value == HUGE_VAL || value == -HUGE_VAL) && errno == ERANGE)
     return nil;
   return flo(value);
 }
 
+val flo_str(val str)
+{
+  return flo_substr(str, nil, nil);
+}
+
+val flo_substr(val str, val start, val end)
+{
+  const wchar_t *e, *wcs = num_range(str, start, end, &e);
+  val ret = flo_wcs(wcs, e);
+  gc_hint(str);
+  return ret;
+}
+
 val num_str(val str)
 {
-  const wchar_t *wcs = c_str(str);
-  const wchar_t *nws = wcs + wcsspn(wcs, L"\f\n\r\t\v");
-  const wchar_t *dig = nws + wcsspn(wcs, L"+-");
+  return num_substr(str, nil, nil);
+}
+
+val num_substr(val str, val start, val end)
+{
+  const wchar_t *e, *wcs = num_range(str, start, end, &e);
+  const wchar_t *p = wcs;
+  val ret;
+
+  while (p != e && *p && wcschr(L"\f\n\r\t\v", *p))
+    p++;
+  while (p != e && (*p == '+' || *p == '-'))
+    p++;
+  while (p != e && *p - '0' < 10u)
+    p++;
+
+  if (p != e && (*p == '.' || *p == 'e' || *p == 'E'))
+    ret = flo_wcs(wcs, e);
+  else
+    ret = int_wcs(wcs, e, nil);
 
-  if (wcsspn(dig, L"0123456789") == wcsspn(dig, L"0123456789eE."))
-    return int_str(str, nil);
-  return flo_str(str);
+  gc_hint(str);
+  return ret;
 }
 
 enum less_handling {
@@ -11280,6 +11486,370 @@ val time_parse_utc(val format, val string)
 #endif
 }
 
+/*
+ * Compiled time parsers: the format is translated once into a vector
+ * of matching operations which run directly on the wide character
+ * string, following the field rules of the GNU C library's strptime
+ * in the C locale. Formats using anything else fall back on strptime.
+ */
+
+enum tp_kind {
+  tp_lit, tp_space, tp_num, tp_month, tp_ampm
+};
+
+enum tp_field {
+  tp_year, tp_year2, tp_mon, tp_mday, tp_hour, tp_hour12, tp_min, tp_sec
+};
+
+struct tp_op {
+  enum tp_kind kind;
+  enum tp_field field;
+  wchar_t ch;
+  int ndig, lo, hi;
+};
+
+enum tp_result {
+  tp_struct, tp_local, tp_utc
+};
+
+struct time_parser {
+  struct tp_op *op;
+  int nop, nalloc;
+  char *fmt;
+  enum tp_result result;
+  int hour_valid;
+  struct tm hour_tm;
+  time_t hour_time;
+};
+
+static val time_parser_s, local_k, utc_k;
+
+static const wchar_t *tp_month_name[12] = {
+  L"January", L"February", L"March", L"April", L"May", L"June", L"July",
+  L"August", L"September", L"October", L"November", L"December"
+};
+
+static void time_parser_destroy(val obj)
+{
+  struct time_parser *tp = coerce(struct time_parser *, obj->co.handle);
+  free(tp->op);
+  free(tp->fmt);
+  free(tp);
+}
+
+static struct cobj_ops time_parser_ops = cobj_ops_init(eq,
+                                                       cobj_print_op,
+                                                       time_parser_destroy,
+                                                       cobj_mark_op,
+                                                       cobj_eq_hash_op);
+
+static struct tp_op *tp_add(struct time_parser *tp, enum tp_kind kind)
+{
+  struct tp_op *op;
+
+  if (tp->nop == tp->nalloc) {
+    tp->nalloc = tp->nalloc * 2 + 8;
+    tp->op = coerce(struct tp_op *,
+                    chk_realloc(coerce(mem_t *, tp->op),
+                                tp->nalloc * sizeof *tp->op));
+  }
+
+  op = &tp->op[tp->nop++];
+  op->kind = kind;
+  op->field = tp_year;
+  op->ch = 0;
+  op->ndig = op->lo = op->hi = 0;
+  return op;
+}
+
+static void tp_add_num(struct time_parser *tp, enum tp_field field,
+                       int lo, int hi, int ndig)
+{
+  struct tp_op *op = tp_add(tp, tp_num);
+  op->field = field;
+  op->lo = lo;
+  op->hi = hi;
+  op->ndig = ndig;
+}
+
+static int tp_compile(struct time_parser *tp, const wchar_t *fmt)
+{
+  while (*fmt) {
+    wchar_t ch = *fmt++;
+
+    if (iswspace(ch)) {
+      tp_add(tp, tp_space);
+      continue;
+    }
+
+    if (ch != '%') {
+      tp_add(tp, tp_lit)->ch = ch;
+      continue;
+    }
+
+    switch (*fmt++) {
+    case '%':
+      tp_add(tp, tp_lit)->ch = '%';
+      break;
+    case 'n': case 't':
+      tp_add(tp, tp_space);
+      break;
+    case 'Y':
+      tp_add_num(tp, tp_year, 0, 9999, 4);
+      break;
+    case 'y':
+      tp_add_num(tp, tp_year2, 0, 99, 2);
+      break;
+    case 'm':
+      tp_add_num(tp, tp_mon, 1, 12, 2);
+      break;
+    case 'd': case 'e':
+      tp_add_num(tp, tp_mday, 1, 31, 2);
+      break;
+    case 'H':
+      tp_add_num(tp, tp_hour, 0, 23, 2);
+      break;
+    case 'I':
+      tp_add_num(tp, tp_hour12, 1, 12, 2);
+      break;
+    case 'M':
+      tp_add_num(tp, tp_min, 0, 59, 2);
+      break;
+    case 'S':
+      tp_add_num(tp, tp_sec, 0, 61, 2);
+      break;
+    case 'b': case 'B': case 'h':
+      tp_add(tp, tp_month);
+      break;
+    case 'p':
+      tp_add(tp, tp_ampm);
+      break;
+    case 'D':
+      if (!tp_compile(tp, L"%m/%d/%y"))
+        return 0;
+      break;
+    case 'F':
+      if (!tp_compile(tp, L"%Y-%m-%d"))
+        return 0;
+      break;
+    case 'R':
+      if (!tp_compile(tp, L"%H:%M"))
+        return 0;
+      break;
+    case 'T':
+      if (!tp_compile(tp, L"%H:%M:%S"))
+        return 0;
+      break;
+    default:
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+static const wchar_t *tp_match_name(const wchar_t *str, const wchar_t *name,
+                                    size_t len)
+{
+  size_t i;
+
+  for (i = 0; i < len; i++)
+    if (towlower(str[i]) != towlower(name[i]))
+      return 0;
+
+  return str + len;
+}
+
+static int tp_run(struct time_parser *tp, const wchar_t *str, struct tm *ptm)
+{
+  struct tp_op *op = tp->op, *end = op + tp->nop;
+  int have_i = 0, is_pm = 0;
+
+  for (; op < end; op++) {
+    switch (op->kind) {
+    case tp_lit:
+      if (*str++ != op->ch)
+        return 0;
+      break;
+    case tp_space:
+      while (iswspace(*str))
+        str++;
+      break;
+    case tp_num:
+      {
+        int val = 0, n = op->ndig;
+
+        while (iswspace(*str))
+          str++;
+
+        if (*str < '0' || *str > '9')
+          return 0;
+
+        do
+          val = val * 10 + (*str++ - '0');
+        while (--n > 0 && val * 10 <= op->hi && *str >= '0' && *str <= '9');
+
+        if (val < op->lo || val > op->hi)
+          return 0;
+
+        switch (op->field) {
+        case tp_year:
+          ptm->tm_year = val - 1900;
+          break;
+        case tp_year2:
+          ptm->tm_year = if3(val >= 69, val, val + 100);
+          break;
+        case tp_mon:
+          ptm->tm_mon = val - 1;
+          break;
+        case tp_mday:
+          ptm->tm_mday = val;
+          break;
+        case tp_hour:
+          ptm->tm_hour = val;
+          have_i = 0;
+          break;
+        case tp_hour12:
+          ptm->tm_hour = val % 12;
+          have_i = 1;
+          break;
+        case tp_min:
+          ptm->tm_min = val;
+          break;
+        case tp_sec:
+          ptm->tm_sec = val;
+          break;
+        }
+      }
+      break;
+    case tp_month:
+      {
+        const wchar_t *next = 0;
+        int i;
+
+        for (i = 0; i < 12 && next == 0; i++) {
+          const wchar_t *name = tp_month_name[i];
+          if ((next = tp_match_name(str, name, wcslen(name))) == 0)
+            next = tp_match_name(str, name, 3);
+        }
+
+        if (next == 0)
+          return 0;
+
+        ptm->tm_mon = i - 1;
+        str = next;
+      }
+      break;
+    case tp_ampm:
+      if (tp_match_name(str, L"AM", 2))
+        is_pm = 0;
+      else if (tp_match_name(str, L"PM", 2))
+        is_pm = 1;
+      else
+        return 0;
+      str += 2;
+      break;
+    }
+  }
+
+  if (have_i && is_pm)
+    ptm->tm_hour += 12;
+
+  return 1;
+}
+
+/*
+ * Days from 1970-01-01 to the given proleptic Gregorian date
+ * (H. Hinnant's days_from_civil algorithm).
+ */
+static cnum tp_days(cnum year, int mon, int mday)
+{
+  cnum y = year - (mon <= 2);
+  cnum era = (y >= 0 ? y : y - 399) / 400;
+  cnum yoe = y - era * 400;
+  cnum doy = (153 * (mon + if3(mon > 2, -3, 9)) + 2) / 5 + mday - 1;
+  cnum doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+/*
+ * Local times within the same hour share the epoch of the start
+ * of that hour, so mktime is called only when the hour changes.
+ */
+static val tp_local_time(struct time_parser *tp, struct tm *ptm)
+{
+  struct tm *htm = &tp->hour_tm;
+
+  if (!tp->hour_valid || htm->tm_year != ptm->tm_year ||
+      htm->tm_mon != ptm->tm_mon || htm->tm_mday != ptm->tm_mday ||
+      htm->tm_hour != ptm->tm_hour)
+  {
+    struct tm tms = *ptm;
+    tms.tm_min = tms.tm_sec = 0;
+    *htm = *ptm;
+    tp->hour_time = mktime(&tms);
+    tp->hour_valid = (tp->hour_time != -1);
+
+    if (!tp->hour_valid)
+      return num(mktime(ptm));
+  }
+
+  return num(tp->hour_time + ptm->tm_min * 60 + ptm->tm_sec);
+}
+
+static val time_parser_fun(val obj, val string)
+{
+  struct time_parser *tp = coerce(struct time_parser *,
+                                  cobj_handle(obj, time_parser_s));
+  struct tm tms = epoch_tm();
+
+  if (tp->fmt) {
+    char *str = utf8_dup_to(c_str(string));
+    char *ptr = strptime(str, tp->fmt, &tms);
+    free(str);
+    if (ptr == 0)
+      return nil;
+  } else if (!tp_run(tp, c_str(string), &tms)) {
+    return nil;
+  }
+
+  gc_hint(string);
+
+  switch (tp->result) {
+  case tp_local:
+    return tp_local_time(tp, &tms);
+  case tp_utc:
+    return num(tp_days(tms.tm_year + convert(cnum, 1900),
+                       tms.tm_mon + 1, tms.tm_mday) * 86400 +
+               tms.tm_hour * 3600 + tms.tm_min * 60 + tms.tm_sec);
+  case tp_struct:
+  default:
+    return broken_time_struct(&tms);
+  }
+}
+
+val time_parser(val format, val result)
+{
+  val self = lit("time-parser");
+  struct time_parser *tp = coerce(struct time_parser *,
+                                  chk_calloc(1, sizeof *tp));
+  val obj = cobj(coerce(mem_t *, tp), time_parser_s, &time_parser_ops);
+
+  if (missingp(result) || !result)
+    tp->result = tp_struct;
+  else if (result == local_k)
+    tp->result = tp_local;
+  else if (result == utc_k)
+    tp->result = tp_utc;
+  else
+    uw_throwf(error_s, lit("~a: invalid result type ~s"), self, result, nao);
+
+  if (!tp_compile(tp, c_str(format)))
+    tp->fmt = utf8_dup_to(c_str(format));
+
+  return func_f1(obj, time_parser_fun);
+}
+
 #endif
 
 static void time_init(void)
@@ -11314,6 +11884,10 @@ static void time_init(void)
   static_slot_set(time_st, time_string_s, func_n2(time_string_meth));
 #if HAVE_STRPTIME
   static_slot_set(time_st, time_parse_s, func_n3(time_parse_meth));
+
+  time_parser_s = intern(lit("time-parser"), user_package);
+  local_k = intern(lit("local"), keyword_package);
+  utc_k = intern(lit("utc"), keyword_package);
 #endif
 }
 
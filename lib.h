@@ -777,8 +777,11 @@ val str_gt(val astr, val bstr);
 val str_le(val astr, val bstr);
 val str_ge(val astr, val bstr);
 val int_str(val str, val base);
+val int_substr(val str, val base, val start, val end);
 val flo_str(val str);
+val flo_substr(val str, val start, val end);
 val num_str(val str);
+val num_substr(val str, val start, val end);
 val int_flo(val f);
 val flo_int(val i);
 val less(val left, val right);
@@ -1082,6 +1085,7 @@ val make_time_utc(val year, val month, val day,
 val time_parse(val format, val string);
 val time_parse_local(val format, val string);
 val time_parse_utc(val format, val string);
+val time_parser(val format, val result);
 #endif
 
 void init(mem_t *(*oom_realloc)(mem_t *, size_t), val *stack_bottom);
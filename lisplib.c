@@ -290,6 +290,28 @@ static val yield_instantiate(val set_fun)
   return nil;
 }
 
+#if HAVE_POLL
+static val evloop_set_entries(val dlt, val fun)
+{
+  val name[] = {
+    lit("evloop"), lit("evloop-add"), lit("evloop-del"),
+    lit("evloop-timer"), lit("evloop-cancel"), lit("evloop-stop"),
+    lit("evloop-close"), lit("evloop-run"), lit("evloop-spawn"),
+    lit("evloop-wait"), lit("evloop-sleep"),
+    nil
+  };
+  set_dlt_entries(dlt, name, fun);
+  return nil;
+}
+
+static val evloop_instantiate(val set_fun)
+{
+  funcall1(set_fun, nil);
+  load(format(nil, lit("~aevloop.tl"), stdlib_path, nao));
+  return nil;
+}
+#endif
+
 #if HAVE_SOCKETS
 static val sock_set_entries(val dlt, val fun)
 {
@@ -564,6 +586,9 @@ void lisplib_init(void)
   dlt_register(dl_table, except_instantiate, except_set_entries);
   dlt_register(dl_table, type_instantiate, type_set_entries);
   dlt_register(dl_table, yield_instantiate, yield_set_entries);
+#if HAVE_POLL
+  dlt_register(dl_table, evloop_instantiate, evloop_set_entries);
+#endif
 #if HAVE_SOCKETS
   dlt_register(dl_table, sock_instantiate, sock_set_entries);
 #endif
@@ -240,6 +240,35 @@ static val tx_lookup_var(val sym, val bindings)
              if2(!opt_compat || opt_compat <= 138, lookup_var(nil, bindings)));
 }
 
+/*
+ * Equivalent to set_diff(new_bindings, old_bindings, eq_f, nil), without
+ * the generic function calls. Typically, new_bindings is old_bindings with
+ * a few cells pushed on the front, so only those few are examined.
+ */
+static val new_bindings_only(val new_bindings, val old_bindings)
+{
+  list_collect_decl (out, ptail);
+  val iter;
+
+  for (iter = new_bindings; iter && iter != old_bindings; iter = cdr(iter)) {
+    val binding = car(iter);
+    if (!memq(binding, old_bindings))
+      ptail = list_collect(ptail, binding);
+  }
+
+  return out;
+}
+
+/*
+ * Push value onto the list accumulated under var in the collect
+ * bindings alist, with a single scan of that alist.
+ */
+static void coll_accumulate(val var, val value, val *pbindings_coll)
+{
+  val existing = acons_new_c(var, nulloc, mkcloc(*pbindings_coll));
+  set(cdr_l(existing), cons(value, cdr(existing)));
+}
+
 static val tx_lookup_var_ubc(val sym, val bindings, val spec)
 {
   val binding = tx_lookup_var(sym, bindings);
@@ -1004,8 +1033,8 @@ static val h_coll(match_line_ctx *c)
 
           LOG_MATCH("until/last", until_pos);
           if (ul_sym == last_s) {
-            last_bindings = set_diff(until_last_bindings,
-                                     new_bindings, eq_f, nil);
+            last_bindings = new_bindings_only(until_last_bindings,
+                                              new_bindings);
             c->pos = until_pos;
           }
           ul_match = t;
@@ -1017,8 +1046,8 @@ static val h_coll(match_line_ctx *c)
 
       if (new_pos) {
         list_collect_decl (missing, ptail);
-        val strictly_new_bindings = set_diff(new_bindings,
-                                             c->bindings, eq_f, nil);
+        val strictly_new_bindings = new_bindings_only(new_bindings,
+                                                      c->bindings);
         val have_new = strictly_new_bindings;
 
         new_pos = minus(new_pos, c->base);
@@ -1043,14 +1072,10 @@ static val h_coll(match_line_ctx *c)
         for (iter = strictly_new_bindings; iter; iter = cdr(iter))
         {
           val binding = car(iter);
-          val vars_binding = assoc(car(binding), vars);
+          val vars_binding = assql(car(binding), vars);
 
-          if (!have_vars || vars_binding) {
-            val existing = assoc(car(binding), bindings_coll);
-            bindings_coll = acons_new(car(binding),
-                                      cons(cdr(binding), cdr(existing)),
-                                      bindings_coll);
-          }
+          if (!have_vars || vars_binding)
+            coll_accumulate(car(binding), cdr(binding), &bindings_coll);
         }
       }
 
@@ -3022,7 +3047,8 @@ static val v_gather(match_files_ctx *c)
                 c->curfile, c->data_lineno, nao);
         /* Until discards bindings and position, last keeps them. */
         if (ul_sym == last_s) {
-          val last_bindings = set_diff(until_last_bindings, c->bindings, eq_f, nil);
+          val last_bindings = new_bindings_only(until_last_bindings,
+                                                c->bindings);
           c->bindings = nappend2(last_bindings, orig_bindings);
 
           if (success == t) {
@@ -3323,8 +3349,8 @@ static val v_collect(match_files_ctx *c)
                   c->curfile, c->data_lineno, nao);
           /* Until discards bindings and position, last keeps them. */
           if (ul_sym == last_s) {
-            last_bindings = set_diff(until_last_bindings,
-                                     new_bindings, eq_f, nil);
+            last_bindings = new_bindings_only(until_last_bindings,
+                                              new_bindings);
             if (success == t) {
               debuglf(specline, lit("~s: consumed entire file"), op_sym, nao);
               c->data = nil;
@@ -3341,8 +3367,8 @@ static val v_collect(match_files_ctx *c)
 
       if (success) {
         list_collect_decl (missing, ptail);
-        val strictly_new_bindings = set_diff(new_bindings,
-                                             c->bindings, eq_f, nil);
+        val strictly_new_bindings = new_bindings_only(new_bindings,
+                                                      c->bindings);
         val have_new = strictly_new_bindings;
 
         debuglf(specline, lit("~s matched ~a:~d"),
@@ -3364,16 +3390,19 @@ static val v_collect(match_files_ctx *c)
           sem_error(specline, lit("~s failed to bind ~a"),
                     op_sym, missing, nao);
 
-        for (iter = strictly_new_bindings; iter; iter = cdr(iter))
         {
-          val binding = car(iter);
-          val vars_binding = assoc(car(binding), vars);
+          val bc = bindings_coll;
 
-          if (!have_vars || vars_binding) {
-            val existing = assoc(car(binding), bindings_coll);
+          for (iter = strictly_new_bindings; iter; iter = cdr(iter))
+          {
+            val binding = car(iter);
+            val vars_binding = assql(car(binding), vars);
 
-            bindings_coll = acons_new(car(binding), cons(cdr(binding), cdr(existing)), bindings_coll);
+            if (!have_vars || vars_binding)
+              coll_accumulate(car(binding), cdr(binding), &bc);
           }
+
+          bindings_coll = bc;
         }
       }
 
@@ -4262,7 +4291,7 @@ static val v_load(match_files_ctx *c)
       int gc = gc_state(0);
       parser_t parser;
 
-      parse_once(stream, name, &parser);
+      parse_once(stream, name, &parser, t);
       gc_state(gc);
 
       if (parser.errors)
@@ -4298,7 +4327,7 @@ static val v_load(match_files_ctx *c)
         }
       }
     } else {
-      if (!read_eval_stream(stream, std_error)){
+      if (!read_eval_stream(stream, std_error, t)){
         close_stream(stream, nil);
         sem_error(specline, lit("load: ~a contains errors"), path, nao);
       }
@@ -52,6 +52,27 @@
 #define MP_SQUARE 1 /* use separate squaring code? */
 #endif
 
+#ifndef MP_KARATSUBA_THRESH
+#define MP_KARATSUBA_THRESH 32 /* digits; schoolbook multiply below this */
+#endif
+
+#ifndef MP_KARATSUBA_SQR_THRESH
+#define MP_KARATSUBA_SQR_THRESH 48 /* digits; schoolbook square below this */
+#endif
+
+#ifndef MP_BZ_DIV_THRESH
+#define MP_BZ_DIV_THRESH 40 /* digits; long division below this */
+#endif
+
+/*
+ * Decimal conversion times vary by less than the run-to-run noise for
+ * values of MP_RADIX_THRESH from 10 to 160, at sizes from 1000 to
+ * 100000 decimal digits.
+ */
+#ifndef MP_RADIX_THRESH
+#define MP_RADIX_THRESH 40 /* digits; radix conversion splits above this */
+#endif
+
 #ifndef MP_PTAB_SIZE
 /*
  * When building mpprime.c, we build in a table of small prime
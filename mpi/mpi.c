@@ -77,6 +77,9 @@ static mp_size s_mp_defprec = MP_DEFPREC;
 /* This defines the maximum I/O base (minimum is 2) */
 #define MAX_RADIX 64
 
+/* Bound on the table of radix powers for I/O conversions */
+#define MP_RADIX_POWERS 64
+
 /* Constant strings returned by mp_strerror() */
 static const char *mp_err_string[] = {
   "unknown result code", /* say what? */
@@ -150,6 +153,7 @@ mp_err s_mp_sqr(mp_int *a); /* magnitude square */
 #endif
 
 mp_err s_mp_div(mp_int *a, mp_int *b); /* magnitude divide */
+mp_err s_mp_div_bz(mp_int *a, mp_int *b); /* recursive magnitude divide */
 mp_err s_mp_2expt(mp_int *a, mp_digit k); /* a = 2^k */
 int s_mp_cmp(mp_int *a, mp_int *b); /* magnitude comparison */
 int s_mp_cmp_d(mp_int *a, mp_digit d); /* magnitude digit compare */
@@ -926,6 +930,11 @@ mp_err mp_mul(mp_int *a, mp_int *b, mp_int *c)
 
   ARGCHK(a != NULL && b != NULL && c != NULL, MP_BADARG);
 
+#if MP_SQUARE
+  if (a == b)
+    return mp_sqr(a, c);
+#endif
+
   sgn = (SIGN(a) == SIGN(b)) ? MP_ZPOS : MP_NEG;
 
   if (c == b) {
@@ -1038,7 +1047,12 @@ mp_err mp_div(mp_int *a, mp_int *b, mp_int *q, mp_int *r)
   if ((res = mp_init_copy(&rtmp, b)) != MP_OKAY)
     goto CLEANUP;
 
-  if ((res = s_mp_div(&qtmp, &rtmp)) != MP_OKAY)
+  if (USED(b) >= MP_BZ_DIV_THRESH && USED(a) - USED(b) >= MP_BZ_DIV_THRESH)
+    res = s_mp_div_bz(&qtmp, &rtmp);
+  else
+    res = s_mp_div(&qtmp, &rtmp);
+
+  if (res != MP_OKAY)
     goto CLEANUP;
 
   /* Compute the signs for the output */
@@ -1239,56 +1253,47 @@ mp_err mp_mod_d(mp_int *a, mp_digit d, mp_digit *c)
 
 mp_err mp_sqrt(mp_int *a, mp_int *b)
 {
-  mp_size mask_shift;
-  mp_int root, guess, *proot = &root, *pguess = &guess;
-  mp_int guess_sqr;
+  mp_int root, quot;
   mp_err err = MP_MEM;
 
   ARGCHK(a != NULL && b != NULL, MP_BADARG);
 
-  if (mp_cmp_z(b) == MP_LT)
+  if (mp_cmp_z(a) == MP_LT)
     return MP_RANGE;
 
+  if (mp_cmp_z(a) == MP_EQ) {
+    mp_zero(b);
+    return MP_OKAY;
+  }
+
   if ((err = mp_init(&root)))
     goto out;
-  if ((err = mp_init(&guess)))
+  if ((err = mp_init(&quot)))
     goto cleanup_root;
-  if ((err = mp_init(&guess_sqr)))
-    goto cleanup_guess;
 
-  for (mask_shift = s_highest_bit_mp(a) / 2;
-       mask_shift < MP_SIZE_MAX; mask_shift--)
-  {
-    mp_int *temp;
-    int cmp;
+  /* Starting from any root >= sqrt(a), Newton's iteration
+   * root = (root + a / root) / 2 decreases toward floor(sqrt(a)),
+   * and stops decreasing when it gets there.  Since a < 2^bits,
+   * 2^ceil(bits / 2) is a suitable start.
+   */
+  if ((err = s_mp_2expt(&root, (s_highest_bit_mp(a) + 1) / 2)))
+    goto cleanup;
 
-    if ((err = mp_copy(proot, pguess)))
-      goto cleanup;
-    if ((err = s_mp_set_bit(pguess, mask_shift)))
-      goto cleanup;
-    if ((err = mp_copy(pguess, &guess_sqr)))
+  for (;;) {
+    if ((err = mp_div(a, &root, &quot, NULL)))
       goto cleanup;
-    if ((err = s_mp_sqr(&guess_sqr)))
+    if ((err = s_mp_add(&quot, &root)))
       goto cleanup;
-
-    cmp = s_mp_cmp(&guess_sqr, a);
-
-    if (cmp < 0) {
-      temp = proot;
-      proot = pguess;
-      pguess = temp;
-    } else if (cmp == 0) {
-      proot = pguess;
+    s_mp_div_2(&quot);
+    if (s_mp_cmp(&quot, &root) >= 0)
       break;
-    }
+    s_mp_exch(&quot, &root);
   }
 
-  err = mp_copy(proot, b);
+  err = mp_copy(&root, b);
 
 cleanup:
-  mp_clear(&guess_sqr);
-cleanup_guess:
-  mp_clear(&guess);
+  mp_clear(&quot);
 cleanup_root:
   mp_clear(&root);
 out:
@@ -2504,6 +2509,255 @@ mp_size mp_is_pow_two(mp_int *mp)
   return s_mp_ispow2(mp) >= 0;
 }
 
+/* The number of radix digits which fit into one mp_digit, along with
+ * the corresponding power of the radix, which is stored in *pbig.
+ */
+static int s_mp_radix_group(int radix, mp_digit *pbig)
+{
+  mp_digit big = radix;
+  int k = 1;
+
+  while (big <= MP_DIGIT_MAX / convert(mp_digit, radix)) {
+    big *= radix;
+    k++;
+  }
+
+  *pbig = big;
+  return k;
+}
+
+/* Convert the len radix digits at str, which are known to be valid,
+ * into mp.  A whole mp_digit's worth of digits is accumulated
+ * before the multiply-and-add step.
+ */
+static mp_err s_mp_read_base(mp_int *mp, unsigned char *str, size_t len,
+                             int radix)
+{
+  mp_digit big;
+  int k = s_mp_radix_group(radix, &big), j;
+  size_t ix = 0;
+  mp_err res;
+
+  mp_zero(mp);
+
+  while (ix < len) {
+    mp_digit d = 0, mul = 1;
+
+    for (j = 0; j < k && ix < len; j++, ix++) {
+      d = d * radix + s_mp_tovalue(str[ix], radix);
+      mul *= radix;
+    }
+
+    if ((res = s_mp_mul_d(mp, mul)) != MP_OKAY ||
+        (res = s_mp_add_d(mp, d)) != MP_OKAY)
+      return res;
+  }
+
+  return MP_OKAY;
+}
+
+/* Divide-and-conquer conversion of len digits, where pw[i] holds
+ * big^(2^i), and big is radix^k.  The string is split so that its
+ * low part is k * 2^level digits long; the high part is at most as
+ * long.  The value is high * pw[level] + low.
+ */
+static mp_err s_mp_read_rec(mp_int *mp, unsigned char *str, size_t len,
+                            int radix, int k, mp_int *pw, int level)
+{
+  mp_int lo;
+  mp_err res;
+  size_t lw;
+
+  if (level < 0 || len < convert(size_t, k) * MP_RADIX_THRESH)
+    return s_mp_read_base(mp, str, len, radix);
+
+  lw = convert(size_t, k) << level;
+
+  if (len <= lw)
+    return s_mp_read_rec(mp, str, len, radix, k, pw, level - 1);
+
+  if ((res = mp_init(&lo)) != MP_OKAY)
+    return res;
+
+  res = s_mp_read_rec(mp, str, len - lw, radix, k, pw, level - 1);
+  if (res != MP_OKAY)
+    goto CLEANUP;
+
+  res = s_mp_read_rec(&lo, str + len - lw, lw, radix, k, pw, level - 1);
+  if (res != MP_OKAY)
+    goto CLEANUP;
+
+  if ((res = mp_mul(mp, &pw[level], mp)) != MP_OKAY)
+    goto CLEANUP;
+
+  res = s_mp_add(mp, &lo);
+
+CLEANUP:
+  mp_clear(&lo);
+  return res;
+}
+
+static mp_err s_mp_read_mag(mp_int *mp, unsigned char *str, size_t len,
+                            int radix)
+{
+  mp_int pw[MP_RADIX_POWERS];
+  mp_digit big;
+  int k = s_mp_radix_group(radix, &big), npw = 0, level = 0;
+  mp_err res = MP_OKAY;
+
+  if (len < convert(size_t, k) * MP_RADIX_THRESH)
+    return s_mp_read_base(mp, str, len, radix);
+
+  while ((convert(size_t, k) << (level + 1)) < len)
+    level++;
+
+  for (npw = 0; npw <= level; npw++) {
+    if ((res = mp_init(&pw[npw])) != MP_OKAY)
+      goto CLEANUP;
+    if (npw == 0) {
+      mp_set(&pw[npw], big);
+    } else if ((res = mp_sqr(&pw[npw - 1], &pw[npw])) != MP_OKAY) {
+      npw++;
+      goto CLEANUP;
+    }
+  }
+
+  res = s_mp_read_rec(mp, str, len, radix, k, pw, level);
+
+CLEANUP:
+  while (npw-- > 0)
+    mp_clear(&pw[npw]);
+
+  return res;
+}
+
+/* Convert the nonnegative x to radix digits at str, destroying x.  If
+ * width is nonzero, the output is padded with leading zeros to that
+ * many characters; otherwise, it has none.  The number of characters
+ * is stored in *plen.  A whole mp_digit's worth of digits is obtained
+ * from each division of x.
+ */
+static mp_err s_mp_toradix_base(mp_int *x, int radix, int low,
+                                unsigned char *str, size_t width,
+                                size_t *plen)
+{
+  mp_digit big, rem;
+  int k = s_mp_radix_group(radix, &big), j;
+  size_t pos = 0, ix;
+  mp_err res;
+
+  while (mp_cmp_z(x) != 0) {
+    int last;
+
+    if ((res = s_mp_div_d(x, big, &rem)) != MP_OKAY)
+      return res;
+
+    last = (mp_cmp_z(x) == 0);
+
+    for (j = 0; j < k && (!last || rem != 0); j++) {
+      str[pos++] = s_mp_todigit(convert(int, rem % radix), radix, low);
+      rem /= radix;
+    }
+  }
+
+  while (pos < width)
+    str[pos++] = s_mp_todigit(0, radix, low);
+
+  for (ix = 0; ix < pos / 2; ix++) {
+    unsigned char ch = str[ix];
+    str[ix] = str[pos - ix - 1];
+    str[pos - ix - 1] = ch;
+  }
+
+  *plen = pos;
+  return MP_OKAY;
+}
+
+/* Divide-and-conquer conversion of x < pw[level + 1], where pw[i]
+ * holds big^(2^i), and big is radix^k.  The quotient and remainder of
+ * x divided by pw[level] are converted in turn; the remainder is
+ * padded to k * 2^level digits.  If no padding is requested, levels
+ * at which the quotient would be zero are skipped, so that no
+ * leading zeros are produced.
+ */
+static mp_err s_mp_toradix_rec(mp_int *x, mp_int *pw, int level,
+                               int radix, int low, int k,
+                               unsigned char *str, size_t width,
+                               size_t *plen)
+{
+  mp_int q, r;
+  mp_err res;
+  size_t lw, qlen, rlen;
+
+  if (width == 0)
+    while (level >= 0 && s_mp_cmp(x, &pw[level]) < 0)
+      level--;
+
+  if (level < 0 || USED(x) < MP_RADIX_THRESH)
+    return s_mp_toradix_base(x, radix, low, str, width, plen);
+
+  lw = convert(size_t, k) << level;
+
+  if ((res = mp_init(&q)) != MP_OKAY)
+    return res;
+  if ((res = mp_init(&r)) != MP_OKAY)
+    goto R;
+
+  if ((res = mp_div(x, &pw[level], &q, &r)) != MP_OKAY)
+    goto CLEANUP;
+
+  res = s_mp_toradix_rec(&q, pw, level - 1, radix, low, k,
+                         str, width ? width - lw : 0, &qlen);
+  if (res != MP_OKAY)
+    goto CLEANUP;
+
+  res = s_mp_toradix_rec(&r, pw, level - 1, radix, low, k,
+                         str + qlen, lw, &rlen);
+  if (res != MP_OKAY)
+    goto CLEANUP;
+
+  *plen = qlen + rlen;
+
+CLEANUP:
+  mp_clear(&r);
+R:
+  mp_clear(&q);
+
+  return res;
+}
+
+static mp_err s_mp_toradix_mag(mp_int *x, int radix, int low,
+                               unsigned char *str, size_t *plen)
+{
+  mp_int pw[MP_RADIX_POWERS];
+  mp_digit big;
+  int k = s_mp_radix_group(radix, &big), npw;
+  mp_err res;
+
+  if (USED(x) < MP_RADIX_THRESH)
+    return s_mp_toradix_base(x, radix, low, str, 0, plen);
+
+  /* Square until the last power squared is certain to exceed x */
+  for (npw = 0; npw == 0 || 2 * USED(&pw[npw - 1]) - 1 <= USED(x); npw++) {
+    if ((res = mp_init(&pw[npw])) != MP_OKAY)
+      goto CLEANUP;
+    if (npw == 0) {
+      mp_set(&pw[npw], big);
+    } else if ((res = mp_sqr(&pw[npw - 1], &pw[npw])) != MP_OKAY) {
+      npw++;
+      goto CLEANUP;
+    }
+  }
+
+  res = s_mp_toradix_rec(x, pw, npw - 1, radix, low, k, str, 0, plen);
+
+CLEANUP:
+  while (npw-- > 0)
+    mp_clear(&pw[npw]);
+
+  return res;
+}
+
 /* Read an integer from the given string, and set mp to the resulting
  * value.  The input is presumed to be in base 10.  Leading non-digit
  * characters are ignored, and the function reads until a non-digit
@@ -2511,8 +2765,7 @@ mp_size mp_is_pow_two(mp_int *mp)
  */
 mp_err mp_read_radix(mp_int *mp, unsigned char *str, int radix)
 {
-  size_t ix = 0;
-  int val = 0;
+  size_t ix = 0, len = 0;
   mp_err res;
   mp_sign sig = MP_ZPOS;
 
@@ -2538,13 +2791,11 @@ mp_err mp_read_radix(mp_int *mp, unsigned char *str, int radix)
     ++ix;
   }
 
-  while ((val = s_mp_tovalue(str[ix], radix)) >= 0) {
-    if ((res = s_mp_mul_d(mp, radix)) != MP_OKAY)
-      return res;
-    if ((res = s_mp_add_d(mp, val)) != MP_OKAY)
-      return res;
-    ++ix;
-  }
+  while (s_mp_tovalue(str[ix + len], radix) >= 0)
+    ++len;
+
+  if ((res = s_mp_read_mag(mp, str + ix, len, radix)) != MP_OKAY)
+    return res;
 
   if (s_mp_cmp_d(mp, 0) == MP_EQ)
     SIGN(mp) = MP_ZPOS;
@@ -2579,8 +2830,6 @@ mp_size mp_value_radix_size(mp_size num, mp_size qty, int radix)
 
 mp_err mp_toradix_case(mp_int *mp, unsigned char *str, int radix, int low)
 {
-  size_t ix, pos = 0;
-
   ARGCHK(mp != NULL && str != NULL, MP_BADARG);
   ARGCHK(radix > 1 && radix <= MAX_RADIX, MP_RANGE);
 
@@ -2590,47 +2839,25 @@ mp_err mp_toradix_case(mp_int *mp, unsigned char *str, int radix, int low)
   } else {
     mp_err res;
     mp_int tmp;
-    mp_sign sgn;
-    mp_digit rem, rdx = convert(mp_digit, radix);
-    char ch;
+    size_t pos = 0, len;
 
     if ((res = mp_init_copy(&tmp, mp)) != MP_OKAY)
       return res;
 
-    /* Save sign for later, and take absolute value */
-    sgn = SIGN(&tmp); SIGN(&tmp) = MP_ZPOS;
-
-    /* Generate output digits in reverse order */
-    while (mp_cmp_z(&tmp) != 0) {
-      if ((res = s_mp_div_d(&tmp, rdx, &rem)) != MP_OKAY) {
-        mp_clear(&tmp);
-        return res;
-      }
-
-      /* Generate digits, use capital letters */
-      ch = s_mp_todigit(rem, radix, low);
-
-      str[pos++] = ch;
-    }
-
     /* Add - sign if original value was negative */
-    if (sgn == MP_NEG)
+    if (SIGN(&tmp) == MP_NEG) {
       str[pos++] = '-';
+      SIGN(&tmp) = MP_ZPOS;
+    }
 
-    str[pos--] = '\0';
+    res = s_mp_toradix_mag(&tmp, radix, low, str + pos, &len);
 
-    /* Reverse the digits and sign indicator */
-    ix = 0;
-    while (ix < pos) {
-      char tmp2 = str[ix];
+    mp_clear(&tmp);
 
-      str[ix] = str[pos];
-      str[pos] = tmp2;
-      ++ix;
-      --pos;
-    }
+    if (res != MP_OKAY)
+      return res;
 
-    mp_clear(&tmp);
+    str[pos + len] = '\0';
   }
 
   return MP_OKAY;
@@ -3241,7 +3468,7 @@ mp_err s_mp_add_d(mp_int *mp, mp_digit d) /* unsigned digit addition */
   mp_size ix = 1, used = USED(mp);
   mp_digit *dp = DIGITS(mp);
 
-  w = dp[0] + d;
+  w = convert(mp_word, dp[0]) + d;
   dp[0] = ACCUM(w);
   k = CARRYOUT(w);
 
@@ -3304,13 +3531,14 @@ mp_err s_mp_mul_d(mp_int *a, mp_digit d)
 
   /* Single-digit multiplication will increase the precision of the
    * output by at most one digit.  However, we can detect when this
-   * will happen -- if the high-order digit of a, times d, gives a
-   * two-digit result, then the precision of the result will increase;
-   * otherwise it won't.  We use this fact to avoid calling s_mp_pad()
-   * unless absolutely necessary.
+   * will happen -- if the high-order digit of a, times d, plus the
+   * carry into it, which is less than d, gives a two-digit result,
+   * then the precision of the result will increase; otherwise it
+   * won't.  We use this fact to avoid calling s_mp_pad() unless
+   * absolutely necessary.
    */
   max = USED(a);
-  w = dp[max - 1] * convert(mp_word, d);
+  w = dp[max - 1] * convert(mp_word, d) + d;
   if (CARRYOUT(w) != 0) {
     if ((res = s_mp_pad(a, max + 1)) != MP_OKAY)
       return res;
@@ -3342,22 +3570,15 @@ mp_err s_mp_mul_d(mp_int *a, mp_digit d)
 mp_err s_mp_div_d(mp_int *mp, mp_digit d, mp_digit *r)
 {
   mp_word w = 0, t;
-  mp_int quot;
-  mp_err res;
-  mp_digit *dp = DIGITS(mp), *qp;
+  mp_digit *dp = DIGITS(mp), *qp = dp;
   mp_size ix;
 
   if (d == 0)
     return MP_RANGE;
 
-  /* Make room for the quotient */
-  if ((res = mp_init_size(&quot, USED(mp))) != MP_OKAY)
-    return res;
-
-  USED(&quot) = USED(mp); /* so clamping will work below */
-  qp = DIGITS(&quot);
-
-  /* Divide without subtraction */
+  /* Divide without subtraction, in place: each quotient digit
+   * replaces the dividend digit which has just been consumed.
+   */
   for (ix = USED(mp) - 1; ix < MP_SIZE_MAX; ix--) {
     w = (w << DIGIT_BIT) | dp[ix];
 
@@ -3375,9 +3596,8 @@ mp_err s_mp_div_d(mp_int *mp, mp_digit d, mp_digit *r)
   if (r)
     *r = w;
 
-  s_mp_clamp(&quot);
-  mp_exch(&quot, mp);
-  mp_clear(&quot);
+  SIGN(mp) = MP_ZPOS;
+  s_mp_clamp(mp);
 
   return MP_OKAY;
 }
@@ -3475,43 +3695,197 @@ mp_err s_mp_sub(mp_int *a, mp_int *b) /* magnitude subtract */
     return MP_OKAY;
 }
 
-/* Compute a = |a| * |b| */
-mp_err s_mp_mul(mp_int *a, mp_int *b)
+/* Add the na-digit number at a into the nr-digit number at r, which
+ * must be at least as long.  Returns the carry out of the top digit.
+ */
+static mp_digit s_mp_addto(mp_digit *r, mp_size nr, mp_digit *a, mp_size na)
 {
-  mp_word w, k = 0;
-  mp_int tmp;
-  mp_err res;
-  mp_size ix, jx, ua = USED(a), ub = USED(b);
-  mp_digit *pa, *pb, *pt, *pbt;
+  mp_word w = 0;
+  mp_size ix;
 
-  if ((res = mp_init_size(&tmp, ua + ub)) != MP_OKAY)
-    return res;
+  for (ix = 0; ix < na; ix++) {
+    w += convert(mp_word, r[ix]) + a[ix];
+    r[ix] = ACCUM(w);
+    w = CARRYOUT(w);
+  }
 
-  /* This has the effect of left-padding with zeroes... */
-  USED(&tmp) = ua + ub;
+  for (; w && ix < nr; ix++) {
+    w += r[ix];
+    r[ix] = ACCUM(w);
+    w = CARRYOUT(w);
+  }
 
-  /* We're going to need the base value each iteration */
-  pbt = DIGITS(&tmp);
+  return w;
+}
+
+/* Subtract the na-digit number at a from the nr-digit number at r,
+ * which must be at least as long.  Returns the borrow out of the top
+ * digit.
+ */
+static mp_digit s_mp_subfrom(mp_digit *r, mp_size nr, mp_digit *a, mp_size na)
+{
+  mp_word w = 0;
+  mp_size ix;
+
+  for (ix = 0; ix < na; ix++) {
+    w = (RADIX + r[ix]) - w - a[ix];
+    r[ix] = ACCUM(w);
+    w = CARRYOUT(w) ? 0 : 1;
+  }
+
+  for (; w && ix < nr; ix++) {
+    w = (RADIX + r[ix]) - w;
+    r[ix] = ACCUM(w);
+    w = CARRYOUT(w) ? 0 : 1;
+  }
+
+  return w;
+}
+
+/* Schoolbook multiplication of digit vectors: c gets the na + nb
+ * digit product of a and b.
+ */
+static void s_mp_mul_digs(mp_digit *a, mp_size na, mp_digit *b, mp_size nb,
+                          mp_digit *c)
+{
+  mp_word w, k = 0;
+  mp_size ix, jx;
+  mp_digit *pa, *pb, *pt;
+
+  s_mp_setz(c, na + nb);
 
   /* Outer loop:  Digits of b */
 
-  pb = DIGITS(b);
-  for (ix = 0; ix < ub; ++ix, ++pb) {
+  pb = b;
+  for (ix = 0; ix < nb; ++ix, ++pb) {
     if (*pb == 0)
       continue;
 
     /* Inner product:  Digits of a */
-    pa = DIGITS(a);
-    for (jx = 0; jx < ua; ++jx, ++pa) {
-      pt = pbt + ix + jx;
+    pa = a;
+    for (jx = 0; jx < na; ++jx, ++pa) {
+      pt = c + ix + jx;
       w = *pb * convert(mp_word, *pa) + k + *pt;
       *pt = ACCUM(w);
       k = CARRYOUT(w);
     }
 
-    pbt[ix + jx] = k;
+    c[ix + jx] = k;
     k = 0;
   }
+}
+
+/* Karatsuba multiplication of digit vectors: c gets the na + nb digit
+ * product of a and b.  With a = a1 R^h + a0 and b = b1 R^h + b0, the
+ * product is z2 R^2h + z1 R^h + z0, where z0 = a0 b0, z2 = a1 b1 and
+ * z1 = (a0 + a1)(b0 + b1) - z0 - z2: three half-size products instead
+ * of four.  Below MP_KARATSUBA_THRESH digits, schoolbook
+ * multiplication is faster.
+ */
+static mp_err s_mp_kmul(mp_digit *a, mp_size na, mp_digit *b, mp_size nb,
+                        mp_digit *c)
+{
+  mp_err res = MP_OKAY;
+  mp_digit *t, *sa, *sb, *z1;
+  mp_size h, la, lb, lz;
+
+  if (na < nb) {
+    mp_digit *tp = a;
+    mp_size tn = na;
+    a = b; na = nb;
+    b = tp; nb = tn;
+  }
+
+  if (nb < MP_KARATSUBA_THRESH) {
+    s_mp_mul_digs(a, na, b, nb, c);
+    return MP_OKAY;
+  }
+
+  /* If b is less than half as long as a, splitting a in half would
+   * leave b without a high half. Instead, multiply b by successive
+   * pieces of a which are no longer than b.
+   */
+  if (nb <= na / 2) {
+    mp_size off;
+
+    t = coerce(mp_digit *, s_mp_alloc(2 * nb, sizeof (mp_digit)));
+    if (t == NULL)
+      return MP_MEM;
+
+    s_mp_setz(c, na + nb);
+
+    for (off = 0; off < na; off += nb) {
+      mp_size len = MIN(nb, na - off);
+      if ((res = s_mp_kmul(b, nb, a + off, len, t)) != MP_OKAY)
+        break;
+      s_mp_addto(c + off, na + nb - off, t, nb + len);
+    }
+
+    s_mp_free(t);
+    return res;
+  }
+
+  h = na / 2;
+  la = na - h + 1;
+  lb = MAX(h, nb - h) + 1;
+  lz = la + lb;
+
+  t = coerce(mp_digit *, s_mp_alloc(la + lb + lz, sizeof (mp_digit)));
+  if (t == NULL)
+    return MP_MEM;
+
+  sa = t;
+  sb = sa + la;
+  z1 = sb + lb;
+
+  /* z0 and z2 go directly into the low and high parts of c */
+  if ((res = s_mp_kmul(a, h, b, h, c)) != MP_OKAY)
+    goto CLEANUP;
+  if ((res = s_mp_kmul(a + h, na - h, b + h, nb - h, c + 2 * h)) != MP_OKAY)
+    goto CLEANUP;
+
+  s_mp_copy(a + h, sa, na - h);
+  sa[na - h] = s_mp_addto(sa, na - h, a, h);
+
+  if (nb - h >= h) {
+    s_mp_copy(b + h, sb, nb - h);
+    sb[nb - h] = s_mp_addto(sb, nb - h, b, h);
+  } else {
+    s_mp_copy(b, sb, h);
+    sb[h] = s_mp_addto(sb, h, b + h, nb - h);
+  }
+
+  if ((res = s_mp_kmul(sa, la, sb, lb, z1)) != MP_OKAY)
+    goto CLEANUP;
+
+  s_mp_subfrom(z1, lz, c, 2 * h);
+  s_mp_subfrom(z1, lz, c + 2 * h, na + nb - 2 * h);
+
+  /* Any digits of z1 which don't fit are zero */
+  s_mp_addto(c + h, na + nb - h, z1, MIN(lz, na + nb - h));
+
+CLEANUP:
+  s_mp_free(t);
+  return res;
+}
+
+/* Compute a = |a| * |b| */
+mp_err s_mp_mul(mp_int *a, mp_int *b)
+{
+  mp_int tmp;
+  mp_err res;
+  mp_size ua = USED(a), ub = USED(b);
+
+  if ((res = mp_init_size(&tmp, ua + ub)) != MP_OKAY)
+    return res;
+
+  USED(&tmp) = ua + ub;
+
+  res = s_mp_kmul(DIGITS(a), ua, DIGITS(b), ub, DIGITS(&tmp));
+  if (res != MP_OKAY) {
+    mp_clear(&tmp);
+    return res;
+  }
 
   s_mp_clamp(&tmp);
   s_mp_exch(&tmp, a);
@@ -3521,36 +3895,27 @@ mp_err s_mp_mul(mp_int *a, mp_int *b)
   return MP_OKAY;
 }
 
-/* Computes the square of a, in place.  This can be done more
- * efficiently than a general multiplication, because many of the
- * computation steps are redundant when squaring.  The inner product
- * step is a bit more complicated, but we save a fair number of
- * iterations of the multiplication loop.
- */
 #if MP_SQUARE
-mp_err s_mp_sqr(mp_int *a)
+/* Computes the square of the used-digit vector pa into the 2 * used
+ * digit vector pbt.  This can be done more efficiently than a general
+ * multiplication, because many of the computation steps are redundant
+ * when squaring.  The inner product step is a bit more complicated,
+ * but we save a fair number of iterations of the multiplication loop.
+ */
+static void s_mp_sqr_digs(mp_digit *pa, mp_size used, mp_digit *pbt)
 {
   mp_word w, k = 0;
-  mp_int tmp;
-  mp_err res;
-  mp_size ix, jx, kx, used = USED(a);
-  mp_digit *pa1, *pa2, *pt, *pbt;
-
-  if ((res = mp_init_size(&tmp, 2 * used)) != MP_OKAY)
-    return res;
-
-  /* Left-pad with zeroes */
-  USED(&tmp) = 2 * used;
+  mp_size ix, jx, kx;
+  mp_digit *pa1, *pa2, *pt;
 
-  /* We need the base value each time through the loop */
-  pbt = DIGITS(&tmp);
+  s_mp_setz(pbt, 2 * used);
 
-  pa1 = DIGITS(a);
+  pa1 = pa;
   for (ix = 0; ix < used; ++ix, ++pa1) {
     if (*pa1 == 0)
       continue;
 
-    w = DIGIT(&tmp, ix + ix) + *pa1 * convert(mp_word, *pa1);
+    w = pbt[ix + ix] + *pa1 * convert(mp_word, *pa1);
 
     pbt[ix + ix] = ACCUM(w);
     k = CARRYOUT(w);
@@ -3562,7 +3927,7 @@ mp_err s_mp_sqr(mp_int *a)
      * overflow, we have to check explicitly for overflow conditions
      * before they happen.
      */
-    for (jx = ix + 1, pa2 = DIGITS(a) + jx; jx < used; ++jx, ++pa2) {
+    for (jx = ix + 1, pa2 = pa + jx; jx < used; ++jx, ++pa2) {
       mp_word u = 0, v;
 
       /* Store this in a temporary to avoid indirections later */
@@ -3602,7 +3967,7 @@ mp_err s_mp_sqr(mp_int *a)
     } /* for (jx ...) */
 
     /* Set the last digit in the cycle and reset the carry */
-    k = DIGIT(&tmp, ix + jx) + k;
+    k = pbt[ix + jx] + k;
     pbt[ix + jx] = ACCUM(k);
     k = CARRYOUT(k);
 
@@ -3619,6 +3984,69 @@ mp_err s_mp_sqr(mp_int *a)
       ++kx;
     }
   } /* for (ix ...) */
+}
+
+/* Karatsuba squaring of a digit vector: c gets the 2 * n digit square
+ * of a.  With a = a1 R^h + a0, the square is z2 R^2h + z1 R^h + z0,
+ * where z0 = a0^2, z2 = a1^2 and z1 = (a0 + a1)^2 - z0 - z2.
+ */
+static mp_err s_mp_ksqr(mp_digit *a, mp_size n, mp_digit *c)
+{
+  mp_err res;
+  mp_digit *t, *sa, *z1;
+  mp_size h, la;
+
+  if (n < MP_KARATSUBA_SQR_THRESH) {
+    s_mp_sqr_digs(a, n, c);
+    return MP_OKAY;
+  }
+
+  h = n / 2;
+  la = n - h + 1;
+
+  t = coerce(mp_digit *, s_mp_alloc(3 * la, sizeof (mp_digit)));
+  if (t == NULL)
+    return MP_MEM;
+
+  sa = t;
+  z1 = sa + la;
+
+  if ((res = s_mp_ksqr(a, h, c)) != MP_OKAY)
+    goto CLEANUP;
+  if ((res = s_mp_ksqr(a + h, n - h, c + 2 * h)) != MP_OKAY)
+    goto CLEANUP;
+
+  s_mp_copy(a + h, sa, n - h);
+  sa[n - h] = s_mp_addto(sa, n - h, a, h);
+
+  if ((res = s_mp_ksqr(sa, la, z1)) != MP_OKAY)
+    goto CLEANUP;
+
+  s_mp_subfrom(z1, 2 * la, c, 2 * h);
+  s_mp_subfrom(z1, 2 * la, c + 2 * h, 2 * n - 2 * h);
+  s_mp_addto(c + h, 2 * n - h, z1, MIN(2 * la, 2 * n - h));
+
+CLEANUP:
+  s_mp_free(t);
+  return res;
+}
+
+/* Computes the square of a, in place. */
+mp_err s_mp_sqr(mp_int *a)
+{
+  mp_int tmp;
+  mp_err res;
+  mp_size used = USED(a);
+
+  if ((res = mp_init_size(&tmp, 2 * used)) != MP_OKAY)
+    return res;
+
+  USED(&tmp) = 2 * used;
+
+  if ((res = s_mp_ksqr(DIGITS(a), used, DIGITS(&tmp))) != MP_OKAY) {
+    mp_clear(&tmp);
+    return res;
+  }
 
   s_mp_clamp(&tmp);
   s_mp_exch(&tmp, a);
@@ -3686,9 +4114,12 @@ mp_err s_mp_div(mp_int *a, mp_int *b)
     if (s_mp_cmp(&rem, b) < 0)
       break;
 
-    /* Compute a guess for the next quotient digit */
+    /* Compute a guess for the next quotient digit.  The top two
+     * digits of rem are used only if rem is longer than b; otherwise
+     * the guess can be off by nearly RADIX, rather than by two.
+     */
     q = DIGIT(&rem, USED(&rem) - 1);
-    if (q <= DIGIT(b, USED(b) - 1) && USED(&rem) > 1)
+    if (USED(&rem) > USED(b))
       q = (q << DIGIT_BIT) | DIGIT(&rem, USED(&rem) - 2);
 
     q /= DIGIT(b, USED(b) - 1);
@@ -3746,6 +4177,270 @@ T:
   return res;
 }
 
+/* Set r to the cnt digits of a starting at digit off; that is,
+ * floor(a / RADIX^off) mod RADIX^cnt.  r must not be a.
+ */
+static mp_err s_mp_digs(mp_int *a, mp_size off, mp_size cnt, mp_int *r)
+{
+  mp_err res;
+  mp_size used = USED(a);
+  mp_size n = off < used ? MIN(cnt, used - off) : 0;
+
+  mp_zero(r);
+
+  if (n > 0) {
+    if ((res = s_mp_pad(r, n)) != MP_OKAY)
+      return res;
+    s_mp_copy(DIGITS(a) + off, DIGITS(r), n);
+    s_mp_clamp(r);
+  }
+
+  return MP_OKAY;
+}
+
+/* Left shift by p digits, leaving zero alone. */
+static mp_err s_mp_lshd_z(mp_int *mp, mp_size p)
+{
+  if (mp_cmp_z(mp) == 0)
+    return MP_OKAY;
+  return s_mp_lshd(mp, p);
+}
+
+/* Long division of nonnegative a by positive b into q and r, none of
+ * which may be the same object.
+ */
+static mp_err s_mp_div_long(mp_int *a, mp_int *b, mp_int *q, mp_int *r)
+{
+  mp_err res;
+
+  if (s_mp_cmp(a, b) < 0) {
+    mp_zero(q);
+    return mp_copy(a, r);
+  }
+
+  if ((res = mp_copy(a, q)) != MP_OKAY ||
+      (res = mp_copy(b, r)) != MP_OKAY)
+    return res;
+
+  return s_mp_div(q, r);
+}
+
+static mp_err s_mp_div_3n2n(mp_int *a12, mp_int *a3, mp_int *b,
+                            mp_int *b1, mp_int *b2, mp_size n,
+                            mp_int *q, mp_int *r);
+
+/* The recursive step of Burnikel-Ziegler division: divide a by the n
+ * digit normalized b, where a < b * RADIX^n, giving q and r. The
+ * quotient is calculated in two halves, each of which is a 3n/2 by n
+ * digit division, which is in turn done using an n by n/2 digit
+ * division: a recursive call.  r may be the same object as a, but q
+ * must be distinct.
+ */
+static mp_err s_mp_div_2n1n(mp_int *a, mp_int *b, mp_size n,
+                            mp_int *q, mp_int *r)
+{
+  mp_err res;
+  mp_int a12, a3, a4, b1, b2, q1;
+  mp_size half = n / 2;
+
+  if (n % 2 != 0 || n < MP_BZ_DIV_THRESH) {
+    mp_int t;
+
+    if ((res = mp_init(&t)) != MP_OKAY)
+      return res;
+    if ((res = s_mp_div_long(a, b, q, &t)) == MP_OKAY)
+      s_mp_exch(&t, r);
+    mp_clear(&t);
+    return res;
+  }
+
+  if ((res = mp_init(&a12)) != MP_OKAY)
+    return res;
+  if ((res = mp_init(&a3)) != MP_OKAY)
+    goto A3;
+  if ((res = mp_init(&a4)) != MP_OKAY)
+    goto A4;
+  if ((res = mp_init(&b1)) != MP_OKAY)
+    goto B1;
+  if ((res = mp_init(&b2)) != MP_OKAY)
+    goto B2;
+  if ((res = mp_init(&q1)) != MP_OKAY)
+    goto Q1;
+
+  if ((res = s_mp_digs(a, n, MP_SIZE_MAX, &a12)) != MP_OKAY ||
+      (res = s_mp_digs(a, half, half, &a3)) != MP_OKAY ||
+      (res = s_mp_digs(a, 0, half, &a4)) != MP_OKAY ||
+      (res = s_mp_digs(b, half, MP_SIZE_MAX, &b1)) != MP_OKAY ||
+      (res = s_mp_digs(b, 0, half, &b2)) != MP_OKAY)
+    goto CLEANUP;
+
+  if ((res = s_mp_div_3n2n(&a12, &a3, b, &b1, &b2, half, &q1, r)) != MP_OKAY)
+    goto CLEANUP;
+
+  if ((res = s_mp_div_3n2n(r, &a4, b, &b1, &b2, half, q, r)) != MP_OKAY)
+    goto CLEANUP;
+
+  if ((res = s_mp_lshd_z(&q1, half)) != MP_OKAY)
+    goto CLEANUP;
+
+  res = s_mp_add(q, &q1);
+
+CLEANUP:
+  mp_clear(&q1);
+Q1:
+  mp_clear(&b2);
+B2:
+  mp_clear(&b1);
+B1:
+  mp_clear(&a4);
+A4:
+  mp_clear(&a3);
+A3:
+  mp_clear(&a12);
+
+  return res;
+}
+
+/* Divide a12 * RADIX^n + a3 by b = b1 * RADIX^n + b2, where b1 and b2
+ * have n digits each, and a12 < b.  The quotient is estimated by
+ * dividing a12 by b1, and then corrected; since b is normalized, at
+ * most two corrections are required.  r may be the same object as
+ * a12, but q must be distinct.
+ */
+static mp_err s_mp_div_3n2n(mp_int *a12, mp_int *a3, mp_int *b,
+                            mp_int *b1, mp_int *b2, mp_size n,
+                            mp_int *q, mp_int *r)
+{
+  mp_err res;
+  mp_int t;
+
+  if ((res = mp_init(&t)) != MP_OKAY)
+    return res;
+
+  if ((res = s_mp_digs(a12, n, MP_SIZE_MAX, &t)) != MP_OKAY)
+    goto CLEANUP;
+
+  if (mp_cmp(&t, b1) == 0) {
+    /* q = RADIX^n - 1, r = a12 - b1 * RADIX^n + b1 */
+    mp_set(q, 1);
+    if ((res = s_mp_lshd(q, n)) != MP_OKAY ||
+        (res = mp_sub_d(q, 1, q)) != MP_OKAY ||
+        (res = mp_copy(b1, &t)) != MP_OKAY ||
+        (res = s_mp_lshd(&t, n)) != MP_OKAY ||
+        (res = mp_sub(a12, &t, r)) != MP_OKAY ||
+        (res = mp_add(r, b1, r)) != MP_OKAY)
+      goto CLEANUP;
+  } else {
+    if ((res = s_mp_div_2n1n(a12, b1, n, q, r)) != MP_OKAY)
+      goto CLEANUP;
+  }
+
+  /* r = r * RADIX^n + a3 - q * b2 */
+  if ((res = s_mp_lshd_z(r, n)) != MP_OKAY ||
+      (res = mp_add(r, a3, r)) != MP_OKAY ||
+      (res = mp_mul(q, b2, &t)) != MP_OKAY ||
+      (res = mp_sub(r, &t, r)) != MP_OKAY)
+    goto CLEANUP;
+
+  while (mp_cmp_z(r) < 0) {
+    if ((res = mp_sub_d(q, 1, q)) != MP_OKAY ||
+        (res = mp_add(r, b, r)) != MP_OKAY)
+      goto CLEANUP;
+  }
+
+CLEANUP:
+  mp_clear(&t);
+  return res;
+}
+
+/* Compute a = a / b and b = a mod b, like s_mp_div, using
+ * Burnikel-Ziegler recursive division, whose cost is a small multiple
+ * of that of multiplication.  b is padded so that its length is a
+ * power of two multiple of a size below MP_BZ_DIV_THRESH, so that the
+ * recursion can halve it all the way down; a is then divided by b in
+ * pieces as long as b.
+ */
+mp_err s_mp_div_bz(mp_int *a, mp_int *b)
+{
+  mp_err res;
+  mp_int an, bn, q, r, z, qi;
+  mp_size n = USED(b), m = 1, nn, sigma, nchunks, i;
+  mp_digit d;
+
+  while (n / m >= MP_BZ_DIV_THRESH)
+    m *= 2;
+
+  nn = ((n + m - 1) / m) * m;
+  sigma = nn - n;
+  d = MP_DIGIT_BIT - s_highest_bit(DIGIT(b, n - 1));
+
+  if ((res = mp_init_copy(&an, a)) != MP_OKAY)
+    return res;
+  if ((res = mp_init_copy(&bn, b)) != MP_OKAY)
+    goto BN;
+  if ((res = mp_init(&q)) != MP_OKAY)
+    goto Q;
+  if ((res = mp_init(&r)) != MP_OKAY)
+    goto R;
+  if ((res = mp_init(&z)) != MP_OKAY)
+    goto Z;
+  if ((res = mp_init(&qi)) != MP_OKAY)
+    goto QI;
+
+  SIGN(&an) = SIGN(&bn) = MP_ZPOS;
+
+  if ((d != 0 && (res = s_mp_mul_2d(&an, d)) != MP_OKAY) ||
+      (d != 0 && (res = s_mp_mul_2d(&bn, d)) != MP_OKAY) ||
+      (res = s_mp_lshd(&an, sigma)) != MP_OKAY ||
+      (res = s_mp_lshd(&bn, sigma)) != MP_OKAY)
+    goto CLEANUP;
+
+  nchunks = (USED(&an) + nn - 1) / nn;
+
+  /* Start with the top piece of a as the remainder, unless it is not
+   * less than b, in which case it must be divided.
+   */
+  if ((res = s_mp_digs(&an, (nchunks - 1) * nn, nn, &r)) != MP_OKAY)
+    goto CLEANUP;
+
+  if (s_mp_cmp(&r, &bn) < 0)
+    nchunks--;
+  else
+    mp_zero(&r);
+
+  for (i = nchunks; i-- > 0; ) {
+    if ((res = s_mp_digs(&an, i * nn, nn, &z)) != MP_OKAY ||
+        (res = s_mp_lshd_z(&r, nn)) != MP_OKAY ||
+        (res = s_mp_add(&z, &r)) != MP_OKAY ||
+        (res = s_mp_div_2n1n(&z, &bn, nn, &qi, &r)) != MP_OKAY ||
+        (res = s_mp_lshd_z(&q, nn)) != MP_OKAY ||
+        (res = s_mp_add(&q, &qi)) != MP_OKAY)
+      goto CLEANUP;
+  }
+
+  s_mp_rshd(&r, sigma);
+  if (d != 0)
+    s_mp_div_2d(&r, d);
+
+  s_mp_exch(&q, a);
+  s_mp_exch(&r, b);
+
+CLEANUP:
+  mp_clear(&qi);
+QI:
+  mp_clear(&z);
+Z:
+  mp_clear(&r);
+R:
+  mp_clear(&q);
+Q:
+  mp_clear(&bn);
+BN:
+  mp_clear(&an);
+
+  return res;
+}
+
 mp_err s_mp_2expt(mp_int *a, mp_digit k)
 {
   mp_err res;
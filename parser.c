@@ -112,6 +112,9 @@ void parser_common_init(parser_t *p)
   p->lineno = 1;
   p->errors = 0;
   p->eof = 0;
+  p->read_ahead = 0;
+  p->ahead = 0;
+  p->ahead_pos = p->ahead_len = 0;
   p->stream = nil;
   p->name = nil;
   p->prepared_msg = nil;
@@ -135,12 +138,18 @@ void parser_cleanup(parser_t *p)
   if (p->scanner != 0)
     yylex_destroy(p->scanner);
   p->scanner = 0;
+  free(p->ahead);
+  p->ahead = 0;
+  p->ahead_pos = p->ahead_len = 0;
 }
 
 void parser_reset(parser_t *p)
 {
   yyscan_t yyscan;
-  parser_cleanup(p);
+  if (p->scanner != 0) {
+    scanner_save_ahead(p->scanner);
+    yylex_destroy(p->scanner);
+  }
   yylex_init(&yyscan);
   p->scanner = convert(scanner_t *, yyscan);
   yyset_extra(p, p->scanner);
@@ -577,18 +586,27 @@ val iread(val source_in, val error_stream, val error_return_val,
                          name_in, lineno);
 }
 
-val read_eval_stream(val stream, val error_stream)
+val read_eval_stream(val stream, val error_stream, val read_ahead)
 {
   val error_val = gensym(nil);
   val name = stream_get_prop(stream, name_k);
+  parser_t *pi = get_parser_impl(ensure_parser(stream));
+  volatile int saved_read_ahead = pi->read_ahead;
+  val ret = t;
+
+  uw_simple_catch_begin;
+
+  pi->read_ahead = read_ahead && !real_time_stream_p(stream);
 
   for (;;) {
     val form = lisp_parse(stream, error_stream, error_val, name, colon_k);
     val parser = get_parser(stream);
 
     if (form == error_val) {
-      if (parser_errors(parser) != zero)
-        return nil;
+      if (parser_errors(parser) != zero) {
+        ret = nil;
+        break;
+      }
       if (parser_eof(parser))
         break;
       continue;
@@ -600,7 +618,13 @@ val read_eval_stream(val stream, val error_stream)
       break;
   }
 
-  return t;
+  uw_unwind {
+    pi->read_ahead = saved_read_ahead;
+  }
+
+  uw_catch_end;
+
+  return ret;
 }
 
 #if HAVE_TERMIOS
@@ -629,7 +653,7 @@ static void load_rcfile(val name)
     } else {
       val saved_dyn_env = set_dyn_env(make_env(nil, nil, dyn_env));
       env_vbind(dyn_env, load_path_s, resolved_name);
-      read_eval_stream(stream, std_output);
+      read_eval_stream(stream, std_output, t);
       dyn_env = saved_dyn_env;
     }
   }
@@ -51,6 +51,9 @@ struct parser {
   cnum lineno;
   int errors;
   int eof;
+  int read_ahead;
+  mem_t *ahead;
+  size_t ahead_pos, ahead_len;
   val stream;
   val name;
   val prepared_msg;
@@ -99,7 +102,8 @@ void parser_resolve_circ(parser_t *);
 void parser_circ_def(parser_t *, val num, val expr);
 val parser_circ_ref(parser_t *, val num);
 void scrub_scanner(scanner_t *, int yy_char, wchar_t *lexeme);
-int parse_once(val stream, val name, parser_t *parser);
+void scanner_save_ahead(scanner_t *);
+int parse_once(val stream, val name, parser_t *parser, val read_ahead);
 int parse(parser_t *parser, val name, enum prime_parser);
 val source_loc(val form);
 val source_loc_str(val form, val alt);
@@ -116,7 +120,7 @@ val lisp_parse(val source_in, val error_stream, val error_return_val,
                val name_in, val lineno);
 val iread(val source_in, val error_stream, val error_return_val,
           val name_in, val lineno);
-val read_eval_stream(val stream, val error_stream);
+val read_eval_stream(val stream, val error_stream, val read_ahead);
 #if HAVE_TERMIOS
 val repl(val bindings, val in_stream, val out_stream);
 #endif
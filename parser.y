@@ -1832,7 +1832,7 @@ void yybadtoken(parser_t *parser, int tok, val context)
         yyerrorf(scnr, lit("unexpected character ~a"), chr(tok), nao);
 }
 
-int parse_once(val stream, val name, parser_t *parser)
+int parse_once(val stream, val name, parser_t *parser, val read_ahead)
 {
   int res = 0;
 #if CONFIG_DEBUG_SUPPORT
@@ -1844,6 +1844,7 @@ int parse_once(val stream, val name, parser_t *parser)
 
   parser->stream = stream;
   parser->name = name;
+  parser->read_ahead = read_ahead && !real_time_stream_p(stream);
 
   uw_catch_begin(cons(error_s, nil), esym, eobj);
 
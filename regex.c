@@ -2958,79 +2958,180 @@ val regex_range_search_fun(val regex, val start, val from_end)
   return curry_1234_1(func_n4(range_regex), regex, start, from_end);
 }
 
-val read_until_match(val regex, val stream_in, val include_match_in)
+/*
+ * Is the machine unable to consume any further character? A match it
+ * has made then cannot be extended.
+ */
+static int regex_machine_final(regex_machine_t *regm)
+{
+  if (regm->n.is_nfa) {
+    int i;
+
+    for (i = 0; i < regm->n.nclos; i++) {
+      switch (regm->n.set[i]->a.kind) {
+      case nfa_wild:
+      case nfa_single:
+      case nfa_set:
+        return 0;
+      default:
+        break;
+      }
+    }
+
+    return 1;
+  }
+
+  return regm->d.deriv == nil || regm->d.deriv == t;
+}
+
+/*
+ * Run the machine over str, anchored at its start. Returns the length
+ * of the longest match, -1 if nothing matches there, or -2 if the
+ * outcome depends on characters beyond len that haven't been read yet.
+ * *pdead is set if the very first character was rejected, which means
+ * no nonempty match can begin with that character anywhere.
+ */
+static cnum regex_prefix_match(regex_machine_t *regm,
+                               const wchar_t *str, cnum len, int at_eof,
+                               int *pdead)
+{
+  cnum i;
+
+  regex_machine_reset(regm);
+
+  for (i = 0; i < len; i++)
+    if (regex_machine_feed(regm, str[i]) == REGM_FAIL)
+      break;
+
+  *pdead = (i == 0 && len > 0);
+
+  if (i == len && !at_eof && !regex_machine_final(regm))
+    return -2;
+
+  return if3(regex_machine_feed(regm, 0) == REGM_FAIL,
+             -1, regm->n.last_accept_pos);
+}
+
+enum { REC_BUF_CHUNK = 4096 };
+
+/*
+ * Read more characters into the record buffer. In bulk mode, used by
+ * the record adapter which keeps its buffer between records, a block of
+ * whatever input the stream has on hand is taken. Otherwise, just one
+ * character is read, so that little is left over to push back.
+ * Returns zero if nothing could be read.
+ */
+static int rec_buf_fill(struct rec_buf *rb, val stream, int bulk)
+{
+  cnum avail = rb->end - rb->start;
+  cnum want = if3(bulk, REC_BUF_CHUNK, 1);
+  cnum got;
+
+  if (rb->start > 0) {
+    wmemmove(rb->data, rb->data + rb->start, avail);
+    rb->start = 0;
+    rb->end = avail;
+  }
+
+  if (rb->size - rb->end < want) {
+    cnum nsize = if3(rb->size, rb->size, 256);
+    while (nsize - rb->end < want)
+      nsize *= 2;
+    rb->data = coerce(wchar_t *, chk_grow_vec(coerce(mem_t *, rb->data),
+                                              rb->size, nsize,
+                                              sizeof *rb->data));
+    rb->size = nsize;
+  }
+
+  if (bulk) {
+    got = get_chars_avail(stream, rb->data + rb->end, want);
+  } else {
+    val ch = get_char(stream);
+    got = 0;
+    if (ch)
+      rb->data[rb->end + got++] = c_chr(ch);
+  }
+
+  rb->end += got;
+  return got > 0;
+}
+
+void rec_buf_unget(struct rec_buf *rb, val stream)
+{
+  unget_chars(stream, rb->data + rb->start, rb->end - rb->start);
+  free(rb->data);
+  rb->data = 0;
+  rb->start = rb->end = rb->size = 0;
+}
+
+val read_until_match_buf(val regex, val stream, val include_match,
+                         struct rec_buf *rb, int bulk)
 {
   regex_machine_t regm;
+  cnum i = 0, mlen = 0;
+  int eof = 0, dead;
+  unsigned char no_start[256];
   val out = nil;
-  val stack = nil;
-  val match = nil;
-  val stream = default_arg(stream_in, std_input);
-  val include_match = default_null_arg(include_match_in);
 
+  memset(no_start, 0, sizeof no_start);
   regex_machine_init(&regm, regex);
 
   for (;;) {
-    val ch = get_char(stream);
-
-    if (!ch) {
-      switch (regex_machine_feed(&regm, 0)) {
-      case REGM_FAIL:
-      case REGM_INCOMPLETE:
-        if (match)
-          goto out_match;
-        break;
-      case REGM_MATCH:
-        goto out_match;
-      }
-      break;
-    }
-
-    switch (regex_machine_feed(&regm, c_chr(ch))) {
-    case REGM_FAIL:
-      unget_char(ch, stream);
+    const wchar_t *str = rb->data + rb->start;
+    cnum len = rb->end - rb->start;
 
-      if (match)
-        goto out_match;
+    for (; i < len; i++) {
+      wchar_t ch = str[i];
+      cnum m;
 
-      while (stack)
-        unget_char(rcyc_pop(&stack), stream);
+      if (ch < 256 && no_start[ch])
+        continue;
 
-      ch = get_char(stream);
+      m = regex_prefix_match(&regm, str + i, len - i, eof, &dead);
 
-      if (!out)
-        out = mkstring(one, ch);
-      else
-        string_extend(out, ch);
+      if (m == -2)
+        break;
+      if (m > 0) {
+        mlen = m;
+        goto found;
+      }
+      if (dead && ch < 256)
+        no_start[ch] = 1;
+    }
 
-      regex_machine_reset(&regm);
-      continue;
-    case REGM_MATCH:
-      push(ch, &stack);
-      match = stack;
-      continue;
-    case REGM_INCOMPLETE:
-      push(ch, &stack);
-      continue;
+    if (eof) {
+      if (len == 0 && regex_prefix_match(&regm, str, 0, 1, &dead) < 0)
+        goto out;
+      goto found;
     }
 
-    break;
+    if (!rec_buf_fill(rb, stream, bulk))
+      eof = 1;
   }
 
-  if (nil) {
-out_match:
-    while (stack && stack != match)
-      unget_char(rcyc_pop(&stack), stream);
-    if (!out)
-      out = null_string;
-    if (include_match)
-      out = cat_str(cons(out, stack = nreverse(stack)), nil);
+found:
+  {
+    cnum n = i + if3(include_match, mlen, 0);
+    wchar_t *rec = chk_wmalloc(n + 1);
+    if (n > 0)
+      wmemcpy(rec, rb->data + rb->start, n);
+    rec[n] = 0;
+    out = string_own(rec);
+    rb->start += i + mlen;
   }
 
+out:
   regex_machine_cleanup(&regm);
+  return out;
+}
 
-  while (stack)
-    rcyc_pop(&stack);
-
+val read_until_match(val regex, val stream_in, val include_match_in)
+{
+  struct rec_buf rb = { 0, 0, 0, 0 };
+  val stream = default_arg(stream_in, std_input);
+  val out = read_until_match_buf(regex, stream,
+                                 default_null_arg(include_match_in), &rb, 0);
+  rec_buf_unget(&rb, stream);
   return out;
 }
 
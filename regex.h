@@ -30,6 +30,11 @@ extern val cspace_k, cdigit_k, cword_char_k;
 
 extern wchar_t spaces[];
 
+struct rec_buf {
+  wchar_t *data;
+  cnum start, end, size;
+};
+
 val regex_compile(val regex, val error_stream);
 val regexp(val);
 val regex_source(val regex);
@@ -44,6 +49,9 @@ val match_regst(val str, val regex, val pos);
 val match_regst_right(val str, val regex, val end);
 val regsub(val regex, val repl, val str);
 val read_until_match(val regex, val stream, val keep_match);
+val read_until_match_buf(val regex, val stream, val include_match,
+                         struct rec_buf *rb, int bulk);
+void rec_buf_unget(struct rec_buf *rb, val stream);
 val regex_match_full(val regex, val arg1, val arg2);
 val regex_match_full_fun(val regex, val pos);
 val regex_match_left_fun(val regex, val pos);
@@ -210,6 +210,10 @@ void sig_init(void)
 
 #if HAVE_SIGALTSTACK
 
+/* Big enough for throwing an exception from the SIGSEGV handler,
+   including running any handlers established with handle. */
+#define ALT_STACK_SIZE (SIGSTKSZ > 65536 ? SIGSTKSZ : 65536)
+
 static mem_t *stack;
 
 static void setup_alt_stack(void)
@@ -217,10 +221,10 @@ static void setup_alt_stack(void)
   stack_t ss;
 
   if (!stack)
-    stack = chk_malloc(SIGSTKSZ);
+    stack = chk_malloc(ALT_STACK_SIZE);
 
   ss.ss_sp = stack;
-  ss.ss_size = SIGSTKSZ;
+  ss.ss_size = ALT_STACK_SIZE;
   ss.ss_flags = 0;
 
   if (sigaltstack(&ss, NULL) == -1) {
@@ -237,7 +241,7 @@ static void teardown_alt_stack(void)
     return;
 
   ss.ss_sp = stack;
-  ss.ss_size = SIGSTKSZ;
+  ss.ss_size = ALT_STACK_SIZE;
   ss.ss_flags = SS_DISABLE;
 
   if (sigaltstack(&ss, NULL) == -1)
@@ -254,6 +258,73 @@ static void small_sigfillset(small_sigset_t *ss)
   ss->set = convert(unsigned int, -1);
 }
 
+#if HAVE_SIGALTSTACK && HAVE_UCONTEXT && HAVE_MMAP
+
+static int stack_guard;
+
+/* Installed for SIGSEGV and SIGBUS once a coroutine stack with a
+   guard page exists. A fault in the guard page of the running
+   coroutine becomes a stack-overflow exception; anything else is
+   passed to the handler function, or given the default treatment. */
+static void guard_handler(int sig, siginfo_t *info, void *ctx)
+{
+  val lambda = sig_lambda[sig];
+
+  (void) ctx;
+
+  if (info->si_code > 0 &&
+      uw_stack_guard_fault(coerce(mem_t *, info->si_addr))) {
+    gc_state(0);
+    sig_reload_cache();
+    uw_stack_overflow();
+  }
+
+  if (lambda == nil && info->si_code <= 0)
+    return;
+
+  if (lambda == nil || lambda == t) {
+    signal(sig, SIG_DFL);
+    raise(sig);
+    return;
+  }
+
+  sig_handler(sig);
+}
+
+void sig_stack_guard(void)
+{
+  static struct sigaction blank;
+  struct sigaction sa = blank;
+  small_sigset_t block, saved;
+
+  if (stack_guard)
+    return;
+
+  small_sigfillset(&block);
+  sig_mask(SIG_BLOCK, &block, &saved);
+
+  setup_alt_stack();
+
+  if (stack) {
+    sa.sa_flags = SA_RESTART | SA_SIGINFO | SA_ONSTACK;
+    sa.sa_sigaction = guard_handler;
+    sigfillset(&sa.sa_mask);
+    sigaction(SIGSEGV, &sa, 0);
+    sigaction(SIGBUS, &sa, 0);
+    stack_guard = 1;
+  }
+
+  sig_mask(SIG_SETMASK, &saved, 0);
+}
+
+#else
+
+void sig_stack_guard(void)
+{
+}
+
+#endif
+
 val set_sig_handler(val signo, val lambda)
 {
   static struct sigaction blank;
@@ -272,6 +343,14 @@ val set_sig_handler(val signo, val lambda)
   if (lambda != old_lambda) {
     unsigned long mask = 1UL << sig;
 
+#if HAVE_SIGALTSTACK && HAVE_UCONTEXT && HAVE_MMAP
+    if (stack_guard && (sig == SIGSEGV || sig == SIGBUS)) {
+      if (lambda == nil || lambda == t)
+        sig_deferred &= ~mask;
+      else
+        type_check(lambda, FUN);
+    } else
+#endif
     if (lambda == nil) {
       signal(sig, SIG_IGN);
       sig_deferred &= ~mask;
@@ -296,7 +375,11 @@ val set_sig_handler(val signo, val lambda)
     }
 
 #if HAVE_SIGALTSTACK
-    if ((sig == SIGSEGV || sig == SIGBUS) && (lambda == nil || lambda == t))
+    if ((sig == SIGSEGV || sig == SIGBUS) && (lambda == nil || lambda == t)
+#if HAVE_UCONTEXT && HAVE_MMAP
+        && !stack_guard
+#endif
+       )
         teardown_alt_stack();
 #endif
 
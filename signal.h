@@ -264,6 +264,7 @@ extern val dyn_env; /* eval.c */
 void sig_init(void);
 val set_sig_handler(val signo, val lambda);
 val get_sig_handler(val signo);
+void sig_stack_guard(void);
 #if HAVE_POSIX_SIGS
 int sig_mask(int how, const small_sigset_t *set, small_sigset_t *oldset);
 #endif
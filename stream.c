@@ -50,12 +50,32 @@
 #if HAVE_SYS_WAIT
 #include <sys/wait.h>
 #endif
+#if HAVE_POSIX_SPAWN
+#include <spawn.h>
+#endif
 #if HAVE_WINDOWS_H
 #include <windows.h>
 #endif
 #if HAVE_SOCKETS
 #include <sys/socket.h>
 #endif
+#if HAVE_SYS_STAT
+#include <sys/stat.h>
+#endif
+#if HAVE_SENDFILE
+#include <sys/sendfile.h>
+#endif
+#if HAVE_ZLIB
+#include <zlib.h>
+#endif
+#if HAVE_ZSTD
+#include <zstd.h>
+#endif
+#if HAVE_PTHREAD && HAVE_POLL && WCHAR_MAX > 65535
+#define HAVE_READ_AHEAD 1
+#include <pthread.h>
+#include <poll.h>
+#endif
 #include ALLOCA_H
 #include "lib.h"
 #include "gc.h"
@@ -82,7 +102,9 @@ val print_flo_precision_s, print_flo_digits_s, print_flo_format_s;
 val pprint_flo_format_s, print_base_s, print_circle_s;
 
 val from_start_k, from_current_k, from_end_k;
-val real_time_k, name_k, addr_k, fd_k, byte_oriented_k;
+val real_time_k, name_k, addr_k, fd_k, byte_oriented_k, nonblock_k;
+val read_ahead_k, pending_k;
+val gzip_k, zlib_k, zstd_k;
 val format_s;
 
 val stdio_stream_s;
@@ -91,6 +113,10 @@ val stdio_stream_s;
 val socket_error_s;
 #endif
 
+#if HAVE_POSIX_SPAWN
+static val posix_spawn_s;
+#endif
+
 const wchli_t *path_sep_chars = wli("/");
 
 val shell, shell_arg;
@@ -422,6 +448,41 @@ val make_null_stream(void)
 enum stdio_op { stdio_none, stdio_read, stdio_write };
 #endif
 
+#if HAVE_READ_AHEAD
+
+#define RDAHEAD_BLKSIZE 65536
+#define RDAHEAD_NBLK 2
+
+struct rdahead_blk {
+  wchar_t *data;
+  size_t fill;
+};
+
+/*
+ * State shared between a stdio stream in read-ahead mode and its
+ * worker thread. The worker never touches Lisp objects: it reads the
+ * descriptor, decodes into whichever block is free, and hands blocks
+ * over under the mutex. The main thread consumes the block at index rd.
+ */
+struct rdahead {
+  pthread_t thread;
+  pthread_mutex_t mtx;
+  pthread_cond_t cnd;
+  struct strm_ops *orig_ops;
+  int fd, wake[2];
+  int byte_oriented;
+  int stop, done, err;
+  int rd, wr, nfull, have_cur;
+  size_t pos;
+  unsigned char *pre;
+  size_t npre, prepos;
+  unsigned char *raw;
+  size_t ncarry;
+  struct rdahead_blk blk[RDAHEAD_NBLK];
+};
+
+#endif
+
 struct stdio_handle {
   struct strm_base a;
   FILE *f;
@@ -439,6 +500,10 @@ struct stdio_handle {
   unsigned is_rotated : 8; /* used by tail */
   unsigned is_real_time : 8;
   unsigned is_byte_oriented : 8;
+  unsigned is_nonblock : 8;
+  unsigned is_ibuf : 8;
+  unsigned char *ibuf;
+  size_t ipos, ifill, isize;
 #if CONFIG_STDIO_STRICT
   enum stdio_op last_op;
 #endif
@@ -448,6 +513,9 @@ struct stdio_handle {
   val peer;
   val addr;
 #endif
+#if HAVE_READ_AHEAD
+  struct rdahead *ra;
+#endif
 };
 
 static void stdio_stream_print(val stream, val out, val pretty,
@@ -455,7 +523,11 @@ static void stdio_stream_print(val stream, val out, val pretty,
 {
   struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
   struct strm_ops *ops = coerce(struct strm_ops *, stream->co.ops);
+#if HAVE_READ_AHEAD
+  val name = static_str(h->ra ? h->ra->orig_ops->name : ops->name);
+#else
   val name = static_str(ops->name);
+#endif
   val descr = ops->get_prop(stream, name_k);
 
   (void) pretty;
@@ -473,6 +545,7 @@ static void stdio_stream_destroy(val stream)
   close_stream(stream, nil);
   strm_base_cleanup(&h->a);
   free(h->buf);
+  free(h->ibuf);
   free(h);
 }
 
@@ -481,6 +554,7 @@ static void stdio_stream_mark(val stream)
   struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
   strm_base_mark(&h->a);
   gc_mark(h->descr);
+  gc_mark(h->unget_c);
   gc_mark(h->mode);
   gc_mark(h->err);
 #if HAVE_SOCKETS
@@ -525,6 +599,28 @@ static val stdio_maybe_read_error(val stream)
   return nil;
 }
 
+/*
+ * In non-blocking mode, EAGAIN from the underlying descriptor isn't an
+ * error: the stdio error indicator is reset so that the next operation
+ * can proceed once the descriptor becomes ready again.
+ */
+static int stdio_would_block(struct stdio_handle *h)
+{
+#ifdef EAGAIN
+  if (h->is_nonblock && h->f != 0 && ferror(h->f) &&
+      (errno == EAGAIN
+#if defined EWOULDBLOCK && EWOULDBLOCK != EAGAIN
+       || errno == EWOULDBLOCK
+#endif
+      ))
+  {
+    clearerr(h->f);
+    return 1;
+  }
+#endif
+  return 0;
+}
+
 static val stdio_maybe_error(val stream, val action)
 {
   struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
@@ -556,6 +652,15 @@ static int se_putc(int ch, FILE *f)
   return ret;
 }
 
+static size_t se_fwrite(const unsigned char *buf, size_t nbytes, FILE *f)
+{
+  size_t ret;
+  sig_save_enable;
+  ret = fwrite(buf, 1, nbytes, f);
+  sig_restore_enable;
+  return ret;
+}
+
 static int se_getc(FILE *f)
 {
   int ret;
@@ -617,12 +722,24 @@ static val stdio_put_string(val stream, val str)
 
   if (h->f != 0) {
     const wchar_t *s = c_str(str);
+    size_t len = c_num(length_str(str));
+    unsigned char buf[BUFSIZ];
 
     stdio_switch(h, stdio_write);
 
-    while (*s) {
-      if (!utf8_encode(*s++, stdio_put_char_callback, coerce(mem_t *, h->f)))
+    while (len > 0) {
+      size_t nchar, nbytes = utf8_encode_buf(buf, sizeof buf, s, len, &nchar);
+
+      if (nchar == 0) {
+        if (!utf8_encode(*s, stdio_put_char_callback, coerce(mem_t *, h->f)))
+          return stdio_maybe_error(stream, lit("writing"));
+        nchar = 1;
+      } else if (se_fwrite(buf, nbytes, h->f) != nbytes) {
         return stdio_maybe_error(stream, lit("writing"));
+      }
+
+      s += nchar;
+      len -= nchar;
     }
     return t;
   }
@@ -656,8 +773,11 @@ static val stdio_flush(val stream)
   if (h->f && h->last_op != stdio_write)
     return t;
 #endif
-  return (h->f != 0 && se_fflush(h->f) == 0)
-         ? t : stdio_maybe_error(stream, lit("flushing"));
+  if (h->f != 0 && se_fflush(h->f) == 0)
+    return t;
+  if (stdio_would_block(h))
+    return nil;
+  return stdio_maybe_error(stream, lit("flushing"));
 }
 
 static val stdio_seek(val stream, val offset, enum strm_whence whence)
@@ -667,12 +787,20 @@ static val stdio_seek(val stream, val offset, enum strm_whence whence)
   errno = 0;
 
   if (h->f != 0) {
+    val buffered = unum(h->ifill - h->ipos);
+
     if (offset == zero && whence == strm_cur) {
-      return stdio_ftell(h->f);
+      val pos = stdio_ftell(h->f);
+      return if3(pos, minus(pos, buffered), pos);
     } else {
+      if (whence == strm_cur)
+        offset = minus(offset, buffered);
       if (stdio_fseek(h->f, offset, whence) != negone) {
         utf8_decoder_init(&h->ud);
         h->unget_c = nil;
+        h->ipos = h->ifill = 0;
+        if (h->err == t)
+          h->err = nil;
         return t;
       }
     }
@@ -681,6 +809,16 @@ static val stdio_seek(val stream, val offset, enum strm_whence whence)
   return stdio_maybe_error(stream, lit("seeking"));
 }
 
+/*
+ * Is there input which has been read from the descriptor, but not yet
+ * consumed? Only a handle with its own input buffer can tell; what
+ * a FILE has buffered isn't visible.
+ */
+static int stdio_input_pending(struct stdio_handle *h)
+{
+  return h->unget_c || h->ud.tail != h->ud.head || h->ipos < h->ifill;
+}
+
 static val stdio_get_prop(val stream, val ind)
 {
   struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
@@ -693,10 +831,22 @@ static val stdio_get_prop(val stream, val ind)
     return h->f ? num(fileno(h->f)) : nil;
   } else if (ind == byte_oriented_k) {
     return h->is_byte_oriented ? t : nil;
+  } else if (ind == nonblock_k) {
+    return h->is_nonblock ? t : nil;
+  } else if (ind == pending_k) {
+    return stdio_input_pending(h) ? t : nil;
+#if HAVE_READ_AHEAD
+  } else if (ind == read_ahead_k) {
+    return h->ra ? t : nil;
+#endif
   }
   return nil;
 }
 
+#if HAVE_READ_AHEAD
+static val rdahead_start(val stream, struct stdio_handle *h);
+#endif
+
 static val stdio_set_prop(val stream, val ind, val prop)
 {
   struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
@@ -707,6 +857,26 @@ static val stdio_set_prop(val stream, val ind, val prop)
   } else if (ind == byte_oriented_k) {
     h->is_byte_oriented = prop ? 1 : 0;
     return t;
+#if HAVE_FCNTL_H && defined O_NONBLOCK
+  } else if (ind == nonblock_k && h->f != 0) {
+    int fd = fileno(h->f);
+    int flags = fcntl(fd, F_GETFL);
+
+    if (flags >= 0)
+      flags = fcntl(fd, F_SETFL, if3(prop, flags | O_NONBLOCK,
+                                     flags & ~O_NONBLOCK));
+
+    if (flags < 0)
+      uw_throwf(file_error_s, lit("unable to set :nonblock on ~a: ~d/~s"),
+                stream, num(errno), errno_to_string(num(errno)), nao);
+
+    h->is_nonblock = prop ? 1 : 0;
+    return t;
+#endif
+#if HAVE_READ_AHEAD
+  } else if (ind == read_ahead_k) {
+    return prop ? rdahead_start(stream, h) : t;
+#endif
   }
   return nil;
 }
@@ -798,6 +968,187 @@ val generic_get_line(val stream)
   return out;
 }
 
+/*
+ * Input from pipes, sockets and terminals is buffered in the handle,
+ * rather than in the FILE, with plain read calls. Thus it is known
+ * which input has been taken from the descriptor but not yet consumed,
+ * and a read which would block on a non-blocking descriptor stops
+ * without throwing away what had been gathered so far.
+ */
+enum { STDIO_IBUF_SIZE = 16384 };
+
+static void stdio_ibuf_init(struct stdio_handle *h)
+{
+#if HAVE_SYS_STAT
+  struct stat st;
+
+  if (h->f != 0 && fstat(fileno(h->f), &st) == 0 &&
+      !S_ISREG(st.st_mode) && !S_ISBLK(st.st_mode) && !S_ISDIR(st.st_mode))
+  {
+    h->is_ibuf = 1;
+  }
+#else
+  (void) h;
+#endif
+}
+
+static void stdio_ibuf_room(struct stdio_handle *h)
+{
+  if (h->ipos == h->ifill) {
+    h->ipos = h->ifill = 0;
+  } else if (h->ipos > 0 && h->isize - h->ifill < h->isize / 2) {
+    memmove(h->ibuf, h->ibuf + h->ipos, h->ifill - h->ipos);
+    h->ifill -= h->ipos;
+    h->ipos = 0;
+  }
+
+  if (h->ifill == h->isize) {
+    size_t nsize = if3(h->isize, h->isize * 2, STDIO_IBUF_SIZE);
+    h->ibuf = coerce(unsigned char *, chk_grow_vec(coerce(mem_t *, h->ibuf),
+                                                   h->isize, nsize, 1));
+    h->isize = nsize;
+  }
+}
+
+static void stdio_read_error(val stream, struct stdio_handle *h)
+{
+  val err = num(errno);
+  h->err = err;
+  uw_throwf(file_error_s, lit("error reading ~a: ~d/~s"),
+            stream, err, errno_to_string(err), nao);
+}
+
+static ssize_t stdio_read_fd(val stream, struct stdio_handle *h,
+                          unsigned char *buf, size_t size)
+{
+  ssize_t nread;
+
+  for (;;) {
+    sig_save_enable;
+    nread = read(fileno(h->f), buf, size);
+    sig_restore_enable;
+
+    if (nread >= 0)
+      break;
+#ifdef EAGAIN
+    if (errno == EAGAIN
+#if defined EWOULDBLOCK && EWOULDBLOCK != EAGAIN
+        || errno == EWOULDBLOCK
+#endif
+       )
+    {
+      break;
+    }
+#endif
+    if (errno != EINTR)
+      stdio_read_error(stream, h);
+  }
+
+  if (nread == 0)
+    h->err = t;
+
+  return nread;
+}
+
+/*
+ * Read whatever the descriptor has to offer into the input buffer.
+ * Returns the number of bytes obtained, zero at end of input, or
+ * a negative value if the read would block.
+ */
+static ssize_t stdio_ibuf_fill(val stream, struct stdio_handle *h)
+{
+  ssize_t nread;
+
+  if (h->f == 0)
+    uw_throwf(file_error_s, lit("error reading ~a: file closed"), stream, nao);
+
+  if (h->err == t)
+    return 0;
+
+  stdio_switch(h, stdio_read);
+  stdio_ibuf_room(h);
+
+  if ((nread = stdio_read_fd(stream, h, h->ibuf + h->ifill,
+                          h->isize - h->ifill)) > 0)
+  {
+    h->ifill += nread;
+  }
+
+  return nread;
+}
+
+/*
+ * Ensure that at least need bytes are buffered, unless the input ends
+ * first. If the descriptor would block, a timeout-error is thrown; the
+ * bytes buffered so far stay where they are for the next attempt.
+ */
+static size_t stdio_ibuf_ensure(val stream, struct stdio_handle *h,
+                                size_t need)
+{
+  while (h->ifill - h->ipos < need) {
+    ssize_t nread = stdio_ibuf_fill(stream, h);
+    if (nread == 0)
+      break;
+    if (nread < 0)
+      uw_throwf(timeout_error_s, lit("timed out reading ~a"), stream, nao);
+  }
+
+  return h->ifill - h->ipos;
+}
+
+static int stdio_ibuf_get(mem_t *ctx)
+{
+  struct stdio_handle *h = coerce(struct stdio_handle *, ctx);
+  return if3(h->ipos < h->ifill, h->ibuf[h->ipos++], EOF);
+}
+
+static size_t utf8_seq_len(int lead)
+{
+  if (lead < 0xC0)
+    return 1;
+  if (lead < 0xE0)
+    return 2;
+  if (lead < 0xF0)
+    return 3;
+  if (lead < 0xF5)
+    return 4;
+  return 1;
+}
+
+static val stdio_ibuf_get_char(val stream, struct stdio_handle *h)
+{
+  wint_t ch;
+
+  if (h->is_byte_oriented) {
+    if (stdio_ibuf_ensure(stream, h, 1) == 0)
+      return nil;
+    ch = h->ibuf[h->ipos++];
+    if (ch == 0)
+      ch = 0xDC00;
+  } else {
+    size_t inring = 0;
+    int lead, i;
+
+    for (i = h->ud.tail; i != h->ud.head; i = (i + 1) % 8)
+      inring++;
+
+    if (inring > 0) {
+      lead = h->ud.buf[h->ud.tail];
+    } else if (stdio_ibuf_ensure(stream, h, 1) > 0) {
+      lead = h->ibuf[h->ipos];
+    } else {
+      lead = EOF;
+    }
+
+    if (lead != EOF && utf8_seq_len(lead) > inring)
+      stdio_ibuf_ensure(stream, h, utf8_seq_len(lead) - inring);
+
+    ch = utf8_decode(&h->ud, stdio_ibuf_get, coerce(mem_t *, h));
+  }
+
+  return (ch != WEOF) ? chr(ch) : nil;
+}
+
 static val stdio_get_char(val stream)
 {
   struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
@@ -808,6 +1159,9 @@ static val stdio_get_char(val stream)
   if (h->f) {
     wint_t ch;
 
+    if (h->is_ibuf)
+      return stdio_ibuf_get_char(stream, h);
+
     stdio_switch(h, stdio_read);
 
     if (h->is_byte_oriented) {
@@ -824,118 +1178,436 @@ static val stdio_get_char(val stream)
   return stdio_maybe_read_error(stream);
 }
 
-static val stdio_get_byte(val stream)
-{
-  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+struct bulk_src {
+  FILE *f;
+  const unsigned char *buf;
+  size_t pos, fill;
+  unsigned char *blk;
+  size_t blksize;
+};
 
-  stdio_switch(h, stdio_read);
+static int bulk_src_get(mem_t *ctx)
+{
+  struct bulk_src *b = coerce(struct bulk_src *, ctx);
 
-  if (h->f) {
-    int ch = se_getc(h->f);
-    return (ch != EOF) ? num(ch) : stdio_maybe_read_error(stream);
+  if (b->pos == b->fill) {
+    if (b->f == 0)
+      return EOF;
+    sig_save_enable;
+    b->fill = fread(b->blk, 1, b->blksize, b->f);
+    sig_restore_enable;
+    b->buf = b->blk;
+    b->pos = 0;
+    if (b->fill == 0)
+      return EOF;
   }
-  return stdio_maybe_read_error(stream);
-}
 
-static val stdio_unget_char(val stream, val ch)
-{
-  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
-  mpush(ch, mkloc(h->unget_c, stream));
-  return ch;
+  return b->buf[b->pos++];
 }
 
-static val stdio_unget_byte(val stream, int byte)
+/*
+ * Decode bytes into wbuf, which must have room for fill characters,
+ * returning the number of characters produced. Touches no Lisp
+ * objects and allocates nothing.
+ */
+static size_t decode_bytes(wchar_t *wbuf, const unsigned char *bytes,
+                           size_t fill, int byte_oriented)
 {
-  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+  size_t nch = 0;
 
-  errno = 0;
-  return h->f != 0 && ungetc(byte, coerce(FILE *, h->f)) != EOF
-         ? num_fast(byte)
-         : stdio_maybe_error(stream, lit("writing"));
+  if (byte_oriented) {
+    for (; nch < fill; nch++)
+      wbuf[nch] = if3(bytes[nch] == 0, 0xDC00, bytes[nch]);
+  } else {
+    struct bulk_src b = { 0, 0, 0, 0, 0, 0 };
+    utf8_decoder_t ud;
+    wint_t wch;
+    b.buf = bytes;
+    b.fill = fill;
+    utf8_decoder_init(&ud);
+    while ((wch = utf8_decode(&ud, bulk_src_get, coerce(mem_t *, &b))) != WEOF)
+      wbuf[nch++] = wch;
+  }
+
+  return nch;
 }
 
-static val stdio_put_buf(val stream, val buf, cnum pos)
+/*
+ * Decode the bytes of one line into a newly allocated wide string.
+ * Since a newline byte cannot occur inside a UTF-8 sequence,
+ * the decoding is the same as a character at a time.
+ */
+static wchar_t *decode_line_bytes(const unsigned char *bytes, size_t fill,
+                                  int byte_oriented)
 {
-  val self = lit("put-buf");
-  ucnum len = c_unum(length_buf(buf));
-  mem_t *ptr = buf_get(buf, self);
-  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
-  if (convert(size_t, len) != len || len > INT_PTR_MAX)
-    uw_throwf(error_s, lit("~a: buffer too large"), self, nao);
-  if (convert(ucnum, pos) >= len)
-    return num(len);
-  errno = 0;
-  if (h->f != 0) {
-    cnum nwrit = fwrite(ptr + pos, 1, len - pos, h->f);
-    if (nwrit > 0)
-      return num(pos + nwrit);
-  }
-  stdio_maybe_error(stream, lit("writing"));
-  return zero;
+  wchar_t *wbuf = chk_wmalloc(fill + 1);
+  size_t nch = decode_bytes(wbuf, bytes, fill, byte_oriented);
+
+  wbuf[nch] = 0;
+
+  if (nch < fill)
+    wbuf = coerce(wchar_t *, chk_realloc(coerce(mem_t *, wbuf),
+                                         (nch + 1) * sizeof *wbuf));
+  return wbuf;
 }
 
-static val stdio_fill_buf(val stream, val buf, cnum pos)
+/*
+ * A line is decoded only once all of it, through the newline, has been
+ * buffered; if the descriptor would block before that, the partial line
+ * remains buffered and is completed by a later call.
+ */
+static val stdio_ibuf_get_line(val stream, struct stdio_handle *h)
 {
-  val self = lit("fill-buf");
-  ucnum len = c_unum(length_buf(buf));
-  mem_t *ptr = buf_get(buf, self);
-  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
-  if (convert(size_t, len) != len || len > INT_PTR_MAX)
-    uw_throwf(error_s, lit("~a: buffer too large"), self, nao);
-  if (convert(ucnum, pos) >= len)
-    return num(len);
-  errno = 0;
-  if (h->f != 0) {
-    cnum nread = fread(ptr + pos, 1, len - pos, h->f);
-    if (nread > 0)
-      return unum(pos + nread);
+  size_t avail;
+  unsigned char *nl;
+  int i;
+
+  if (memql(chr('\n'), h->unget_c))
+    return generic_get_line(stream);
+
+  for (i = h->ud.tail; i != h->ud.head; i = (i + 1) % 8)
+    if (h->ud.buf[i] == '\n')
+      return generic_get_line(stream);
+
+  for (;;) {
+    ssize_t nread;
+
+    avail = h->ifill - h->ipos;
+
+    if (avail > 0 && memchr(h->ibuf + h->ipos, '\n', avail) != 0)
+      break;
+
+    if ((nread = stdio_ibuf_fill(stream, h)) == 0)
+      break;
+
+    if (nread < 0)
+      uw_throwf(timeout_error_s, lit("timed out reading ~a"), stream, nao);
   }
-  stdio_maybe_read_error(stream);
-  return zero;
-}
 
-static val stdio_close(val stream, val throw_on_error)
-{
-  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+  if (h->unget_c || h->ud.tail != h->ud.head)
+    return generic_get_line(stream);
 
-  if (h->f != 0 && h->f != stdin && h->f != stdout) {
-    int result = fclose(h->f);
-    h->f = 0;
-    if (result == EOF && throw_on_error) {
-      h->err = num(errno);
-      uw_throwf(file_error_s, lit("error closing ~a: ~d/~s"),
-                stream, num(errno), string_utf8(strerror(errno)), nao);
-    }
-    return result != EOF ? t : nil;
+  if (avail == 0)
+    return nil;
+
+  {
+    unsigned char *start = h->ibuf + h->ipos;
+    size_t len;
+    wchar_t *wbuf;
+
+    nl = coerce(unsigned char *, memchr(start, '\n', avail));
+    len = if3(nl, convert(size_t, nl - start), avail);
+    wbuf = decode_line_bytes(start, len, h->is_byte_oriented);
+    h->ipos += len + (nl != 0);
+    return string_own(wbuf);
   }
-  return nil;
 }
 
-#if HAVE_FTRUNCATE || HAVE_CHSIZE
-static val stdio_truncate(val stream, val len)
+/*
+ * Gather the bytes of a line from the FILE in one go and decode them,
+ * rather than calling through get_char for every character.
+ */
+static val stdio_get_line(val stream)
 {
   struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
-  cnum l = c_num(len);
-#if HAVE_FTRUNCATE
-  typedef off_t trunc_off_t;
-  int (*truncfun)(int, off_t) = ftruncate;
-#else
-  typedef long trunc_off_t;
-  int (*truncfun)(int, long) = chsize;
-#endif
+  unsigned char *volatile bytes = 0;
+  wchar_t *volatile wbuf = 0;
+  size_t size = 0, fill = 0;
+  val out = nil;
+  int ch = EOF;
 
-  if (convert(cnum, convert(trunc_off_t, l)) != l)
-    uw_throwf(error_s, lit("truncate-stream: ~s is too large"), len, nao);
+  if (h->is_ibuf && h->f != 0)
+    return stdio_ibuf_get_line(stream, h);
 
-  return (h->f != 0 && truncfun(fileno(h->f), l) == 0)
-         ? t
-         : stdio_maybe_error(stream, lit("truncating"));
-}
-#else
-#define stdio_truncate unimpl_truncate
-#endif
+  if (h->unget_c || h->f == 0 || h->ud.tail != h->ud.head)
+    return generic_get_line(stream);
 
-#if HAVE_SOCKETS
+  stdio_switch(h, stdio_read);
+
+  uw_simple_catch_begin;
+
+  for (;;) {
+    ch = se_getc(h->f);
+
+    if (ch == EOF || ch == '\n')
+      break;
+
+    if (fill >= size) {
+      size_t newsize = size ? size * 2 : 256;
+      bytes = coerce(unsigned char *, chk_grow_vec(coerce(mem_t *, bytes),
+                                                   size, newsize, 1));
+      size = newsize;
+    }
+
+    bytes[fill++] = ch;
+  }
+
+  if (ch == EOF)
+    stdio_maybe_read_error(stream);
+
+  if (ch != EOF || fill > 0) {
+    wbuf = decode_line_bytes(bytes, fill, h->is_byte_oriented);
+    out = string_own(wbuf);
+    wbuf = 0;
+  }
+
+  uw_unwind {
+    free(bytes);
+    free(wbuf);
+  }
+
+  uw_catch_end;
+
+  return out;
+}
+
+/*
+ * Read the remainder of the stream in blocks with fread, presizing the
+ * result from the file size when it's known. A handle with its own
+ * input buffer reads everything into that buffer first.
+ */
+static val stdio_get_string(val stream)
+{
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+  unsigned char *volatile blk = 0;
+  wchar_t *volatile wbuf = 0;
+  size_t size = BUFSIZ, fill = 0;
+  struct bulk_src b = { 0, 0, 0, 0, 0, 0 };
+  val out = nil;
+
+  if (h->f != 0 && h->is_ibuf) {
+    ssize_t nread;
+
+    while ((nread = stdio_ibuf_fill(stream, h)) != 0)
+      if (nread < 0)
+        uw_throwf(timeout_error_s, lit("timed out reading ~a"), stream, nao);
+
+    b.buf = h->ibuf + h->ipos;
+    b.fill = h->ifill - h->ipos;
+    size = b.fill + 1;
+    h->ipos = h->ifill;
+  } else if (h->f != 0) {
+#if HAVE_SYS_STAT
+    struct stat st;
+    long pos = ftell(h->f);
+
+    if (fstat(fileno(h->f), &st) == 0 && S_ISREG(st.st_mode) &&
+        pos >= 0 && st.st_size > pos)
+    {
+      size = st.st_size - pos + 1;
+    }
+#endif
+    stdio_switch(h, stdio_read);
+    b.f = h->f;
+  }
+
+  uw_simple_catch_begin;
+
+  b.blksize = 65536;
+  b.blk = blk = coerce(unsigned char *, chk_malloc(b.blksize));
+  wbuf = chk_wmalloc(size);
+
+  for (;;) {
+    wint_t ch;
+
+    if (h->unget_c) {
+      ch = c_chr(rcyc_pop(&h->unget_c));
+    } else if (h->is_byte_oriented) {
+      ch = bulk_src_get(coerce(mem_t *, &b));
+      if (ch == 0)
+        ch = 0xDC00;
+    } else {
+      ch = utf8_decode(&h->ud, bulk_src_get, coerce(mem_t *, &b));
+    }
+
+    if (ch == WEOF)
+      break;
+
+    if (fill + 1 >= size) {
+      size_t newsize = size * 2;
+      wbuf = coerce(wchar_t *, chk_grow_vec(coerce(mem_t *, wbuf),
+                                            size, newsize, sizeof *wbuf));
+      size = newsize;
+    }
+
+    wbuf[fill++] = ch;
+  }
+
+  stdio_maybe_read_error(stream);
+
+  wbuf[fill] = 0;
+
+  if (fill + 1 < size)
+    wbuf = coerce(wchar_t *, chk_realloc(coerce(mem_t *, wbuf),
+                                         (fill + 1) * sizeof *wbuf));
+  out = string_own(wbuf);
+  wbuf = 0;
+
+  uw_unwind {
+    free(blk);
+    free(wbuf);
+  }
+
+  uw_catch_end;
+
+  return out;
+}
+
+static val stdio_get_byte(val stream)
+{
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+
+  if (h->f != 0 && h->is_ibuf) {
+    if (stdio_ibuf_ensure(stream, h, 1) == 0)
+      return nil;
+    return num_fast(h->ibuf[h->ipos++]);
+  }
+
+  stdio_switch(h, stdio_read);
+
+  if (h->f) {
+    int ch = se_getc(h->f);
+    return (ch != EOF) ? num(ch) : stdio_maybe_read_error(stream);
+  }
+  return stdio_maybe_read_error(stream);
+}
+
+static val stdio_unget_char(val stream, val ch)
+{
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+  mpush(ch, mkloc(h->unget_c, stream));
+  return ch;
+}
+
+static val stdio_unget_byte(val stream, int byte)
+{
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+
+  if (h->f != 0 && h->is_ibuf) {
+    if (h->ipos == 0) {
+      stdio_ibuf_room(h);
+      memmove(h->ibuf + 1, h->ibuf, h->ifill);
+      h->ifill++;
+    } else {
+      h->ipos--;
+    }
+    h->ibuf[h->ipos] = byte;
+    if (h->err == t)
+      h->err = nil;
+    return num_fast(byte);
+  }
+
+  errno = 0;
+  return h->f != 0 && ungetc(byte, coerce(FILE *, h->f)) != EOF
+         ? num_fast(byte)
+         : stdio_maybe_error(stream, lit("writing"));
+}
+
+static val stdio_put_buf(val stream, val buf, cnum pos)
+{
+  val self = lit("put-buf");
+  ucnum len = c_unum(length_buf(buf));
+  mem_t *ptr = buf_get(buf, self);
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+  if (convert(size_t, len) != len || len > INT_PTR_MAX)
+    uw_throwf(error_s, lit("~a: buffer too large"), self, nao);
+  if (convert(ucnum, pos) >= len)
+    return num(len);
+  errno = 0;
+  if (h->f != 0) {
+    cnum nwrit = fwrite(ptr + pos, 1, len - pos, h->f);
+    if (stdio_would_block(h) || nwrit > 0)
+      return num(pos + nwrit);
+  }
+  stdio_maybe_error(stream, lit("writing"));
+  return zero;
+}
+
+static val stdio_fill_buf(val stream, val buf, cnum pos)
+{
+  val self = lit("fill-buf");
+  ucnum len = c_unum(length_buf(buf));
+  mem_t *ptr = buf_get(buf, self);
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+  if (convert(size_t, len) != len || len > INT_PTR_MAX)
+    uw_throwf(error_s, lit("~a: buffer too large"), self, nao);
+  if (convert(ucnum, pos) >= len)
+    return num(len);
+  errno = 0;
+  if (h->f != 0 && h->is_ibuf) {
+    size_t want = len - pos;
+    size_t avail = h->ifill - h->ipos;
+    size_t got = if3(want < avail, want, avail);
+    ssize_t nread = 1;
+
+    memcpy(ptr + pos, h->ibuf + h->ipos, got);
+    h->ipos += got;
+
+    stdio_switch(h, stdio_read);
+
+    while (got < want && h->err != t &&
+           (nread = stdio_read_fd(stream, h, ptr + pos + got, want - got)) > 0)
+    {
+      got += nread;
+    }
+
+    if (got > 0 || (nread < 0 && h->is_nonblock))
+      return unum(pos + got);
+    if (nread < 0)
+      uw_throwf(timeout_error_s, lit("timed out reading ~a"), stream, nao);
+    return zero;
+  }
+  if (h->f != 0) {
+    cnum nread = fread(ptr + pos, 1, len - pos, h->f);
+    if (stdio_would_block(h) || nread > 0)
+      return unum(pos + nread);
+  }
+  stdio_maybe_read_error(stream);
+  return zero;
+}
+
+static val stdio_close(val stream, val throw_on_error)
+{
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+
+  if (h->f != 0 && h->f != stdin && h->f != stdout) {
+    int result = fclose(h->f);
+    h->f = 0;
+    if (result == EOF && throw_on_error) {
+      h->err = num(errno);
+      uw_throwf(file_error_s, lit("error closing ~a: ~d/~s"),
+                stream, num(errno), string_utf8(strerror(errno)), nao);
+    }
+    return result != EOF ? t : nil;
+  }
+  return nil;
+}
+
+#if HAVE_FTRUNCATE || HAVE_CHSIZE
+static val stdio_truncate(val stream, val len)
+{
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+  cnum l = c_num(len);
+#if HAVE_FTRUNCATE
+  typedef off_t trunc_off_t;
+  int (*truncfun)(int, off_t) = ftruncate;
+#else
+  typedef long trunc_off_t;
+  int (*truncfun)(int, long) = chsize;
+#endif
+
+  if (convert(cnum, convert(trunc_off_t, l)) != l)
+    uw_throwf(error_s, lit("truncate-stream: ~s is too large"), len, nao);
+
+  return (h->f != 0 && truncfun(fileno(h->f), l) == 0)
+         ? t
+         : stdio_maybe_error(stream, lit("truncating"));
+}
+#else
+#define stdio_truncate unimpl_truncate
+#endif
+
+#if HAVE_SOCKETS
 
 static val sock_get_prop(val stream, val ind)
 {
@@ -1016,7 +1688,7 @@ static struct strm_ops stdio_ops =
                 stdio_put_string,
                 stdio_put_char,
                 stdio_put_byte,
-                generic_get_line,
+                stdio_get_line,
                 stdio_get_char,
                 stdio_get_byte,
                 stdio_unget_char,
@@ -1034,62 +1706,609 @@ static struct strm_ops stdio_ops =
                 stdio_clear_error,
                 stdio_get_fd);
 
-#if HAVE_SOCKETS
-static struct strm_ops stdio_sock_ops;
-#endif
+#if HAVE_READ_AHEAD
 
-static void tail_calc(unsigned long *state, int *usec, int *mod)
+static struct strm_ops rdahead_ops;
+
+/*
+ * Length of an incomplete UTF-8 sequence at the end of buf, which
+ * must be held back until the rest of it arrives.
+ */
+static size_t utf8_incomplete_tail(const unsigned char *buf, size_t n)
 {
-  unsigned long count = (*state)++;
-  if (count > 32)
-    count = 32;
-  *usec = 1048576 << (count / 8);
-  *mod = 8 >> (count / 8);
-  if (*mod == 0)
-    *mod = 1;
+  size_t i, lim = if3(n < 3, n, 3);
+
+  for (i = 1; i <= lim; i++) {
+    unsigned char c = buf[n - i];
+
+    if ((c & 0xC0) == 0x80)
+      continue;
+
+    if (c >= 0xC0) {
+      size_t need = if3(c >= 0xF0, 4, if3(c >= 0xE0, 3, 2));
+      return if3(i < need, i, 0);
+    }
+
+    break;
+  }
+
+  return 0;
 }
 
-static void tail_strategy(val stream, unsigned long *state)
+static ssize_t rdahead_read(struct rdahead *ra, unsigned char *buf,
+                            size_t size)
 {
-  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
-  int usec = 0, mod = 0;
-  val mode = nil;
-  struct stdio_mode m, m_r = stdio_mode_init_r;
+  if (ra->prepos < ra->npre) {
+    size_t n = ra->npre - ra->prepos;
+    if (n > size)
+      n = size;
+    memcpy(buf, ra->pre + ra->prepos, n);
+    ra->prepos += n;
+    return n;
+  }
 
-  tail_calc(state, &usec, &mod);
+  for (;;) {
+    struct pollfd pfd[2];
+    ssize_t nread;
 
-  if (h->is_rotated) {
-    /* We already know that the file has rotated. The caller
-     * has read through to the end of the old open file, and
-     * so we can close it now and open a new file.
-     */
-    fclose(h->f);
-    h->f = 0;
-    h->is_rotated = 0;
-  } else if (h->f != 0) {
-    /* We have a file and it hasn't rotated; so sleep on it. */
-    sig_save_enable;
-    usleep_wrap(num(usec));
-    sig_restore_enable;
-  }
+    pfd[0].fd = ra->fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = ra->wake[0];
+    pfd[1].events = POLLIN;
 
-  /* If the state indicates we should poll for a file rotation,
-   * or we have no file ...
-   */
-  if (h->f == 0 || *state % mod == 0) {
-    long save_pos = 0, size;
+    if (poll(pfd, 2, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
 
-    if (h->f != 0 && (save_pos = ftell(h->f)) == -1)
-      return;
+    if (pfd[1].revents != 0)
+      return -2;
 
-    for (;;) {
-      FILE *newf;
+    nread = read(ra->fd, buf, size);
 
-      if (!mode)
-        mode = normalize_mode(&m, h->mode, m_r);
+    if (nread < 0 && (errno == EINTR || errno == EAGAIN ||
+                      errno == EWOULDBLOCK))
+      continue;
 
-      /* Try to open the file.
-       */
+    return nread;
+  }
+}
+
+static void *rdahead_worker(void *arg)
+{
+  struct rdahead *ra = coerce(struct rdahead *, arg);
+
+  for (;;) {
+    struct rdahead_blk *b;
+    ssize_t nread;
+    size_t avail, keep;
+    int stop, eof = 0, err = 0;
+
+    pthread_mutex_lock(&ra->mtx);
+    while (!ra->stop && ra->nfull == RDAHEAD_NBLK)
+      pthread_cond_wait(&ra->cnd, &ra->mtx);
+    stop = ra->stop;
+    b = &ra->blk[ra->wr];
+    pthread_mutex_unlock(&ra->mtx);
+
+    if (stop)
+      break;
+
+    nread = rdahead_read(ra, ra->raw + ra->ncarry,
+                         RDAHEAD_BLKSIZE - ra->ncarry);
+
+    if (nread == -2)
+      break;
+
+    if (nread < 0) {
+      err = errno;
+      nread = 0;
+    }
+
+    eof = (nread == 0);
+    avail = ra->ncarry + nread;
+    keep = if3(eof || ra->byte_oriented, 0,
+               utf8_incomplete_tail(ra->raw, avail));
+
+    b->fill = decode_bytes(b->data, ra->raw, avail - keep, ra->byte_oriented);
+    memmove(ra->raw, ra->raw + avail - keep, keep);
+    ra->ncarry = keep;
+
+    pthread_mutex_lock(&ra->mtx);
+    ra->wr = (ra->wr + 1) % RDAHEAD_NBLK;
+    ra->nfull++;
+    if (eof) {
+      ra->done = 1;
+      ra->err = err;
+    }
+    pthread_cond_broadcast(&ra->cnd);
+    pthread_mutex_unlock(&ra->mtx);
+
+    if (eof)
+      return 0;
+  }
+
+  pthread_mutex_lock(&ra->mtx);
+  ra->done = 1;
+  pthread_cond_broadcast(&ra->cnd);
+  pthread_mutex_unlock(&ra->mtx);
+  return 0;
+}
+
+static void rdahead_free(struct rdahead *ra)
+{
+  int i;
+
+  for (i = 0; i < RDAHEAD_NBLK; i++)
+    free(ra->blk[i].data);
+  free(ra->raw);
+  free(ra->pre);
+  free(ra);
+}
+
+static void rdahead_pre_add(struct rdahead *ra, size_t *size, int byte)
+{
+  if (ra->npre >= *size) {
+    size_t newsize = if3(*size, *size * 2, BUFSIZ);
+    ra->pre = coerce(unsigned char *, chk_grow_vec(coerce(mem_t *, ra->pre),
+                                                   *size, newsize, 1));
+    *size = newsize;
+  }
+
+  ra->pre[ra->npre++] = byte;
+}
+
+/*
+ * Switch a stdio stream into read-ahead mode. The worker has to start
+ * reading the descriptor exactly where the stream's consumer left off,
+ * so bytes still pending in the UTF-8 decoder are handed to it first.
+ * For a seekable file, the descriptor is positioned at the FILE's
+ * logical offset; otherwise, whatever sits in the FILE's buffer is
+ * drained and handed over too.
+ */
+static val rdahead_start(val stream, struct stdio_handle *h)
+{
+  struct strm_ops *ops = coerce(struct strm_ops *, stream->co.ops);
+  struct rdahead *ra;
+  size_t size = 0;
+  sigset_t all, saved;
+  off_t off;
+  int i, res;
+
+  if (h->f == 0 || ops->get_char != stdio_get_char)
+    return nil;
+
+  stdio_switch(h, stdio_read);
+
+  ra = coerce(struct rdahead *, chk_calloc(1, sizeof *ra));
+  ra->orig_ops = ops;
+  ra->fd = fileno(h->f);
+  ra->byte_oriented = h->is_byte_oriented;
+  ra->raw = chk_malloc(RDAHEAD_BLKSIZE);
+  for (i = 0; i < RDAHEAD_NBLK; i++)
+    ra->blk[i].data = chk_wmalloc(RDAHEAD_BLKSIZE);
+
+  for (i = h->ud.tail; i != h->ud.head; i = (i + 1) % 8) {
+    if (h->ud.buf[i] == EOF)
+      break;
+    rdahead_pre_add(ra, &size, h->ud.buf[i]);
+  }
+
+  utf8_decoder_init(&h->ud);
+
+  for (; h->ipos < h->ifill; h->ipos++)
+    rdahead_pre_add(ra, &size, h->ibuf[h->ipos]);
+
+  if (h->is_ibuf) {
+    h->ipos = h->ifill = 0;
+  } else if ((off = ftello(h->f)) < 0 || lseek(ra->fd, off, SEEK_SET) < 0) {
+    int flags = fcntl(ra->fd, F_GETFL), ch;
+
+    if (flags >= 0 && (flags & O_NONBLOCK) == 0)
+      fcntl(ra->fd, F_SETFL, flags | O_NONBLOCK);
+
+    while ((ch = getc(h->f)) != EOF)
+      rdahead_pre_add(ra, &size, ch);
+
+    clearerr(h->f);
+
+    if (flags >= 0 && (flags & O_NONBLOCK) == 0)
+      fcntl(ra->fd, F_SETFL, flags);
+  }
+
+  if (pipe(ra->wake) < 0) {
+    int eno = errno;
+    rdahead_free(ra);
+    uw_throwf(file_error_s, lit("unable to set :read-ahead on ~a: ~d/~s"),
+              stream, num(eno), errno_to_string(num(eno)), nao);
+  }
+
+  fcntl(ra->wake[0], F_SETFD, FD_CLOEXEC);
+  fcntl(ra->wake[1], F_SETFD, FD_CLOEXEC);
+
+  pthread_mutex_init(&ra->mtx, 0);
+  pthread_cond_init(&ra->cnd, 0);
+
+  sigfillset(&all);
+  pthread_sigmask(SIG_BLOCK, &all, &saved);
+  res = pthread_create(&ra->thread, 0, rdahead_worker, ra);
+  pthread_sigmask(SIG_SETMASK, &saved, 0);
+
+  if (res != 0) {
+    close(ra->wake[0]);
+    close(ra->wake[1]);
+    pthread_mutex_destroy(&ra->mtx);
+    pthread_cond_destroy(&ra->cnd);
+    rdahead_free(ra);
+    uw_throwf(file_error_s, lit("unable to set :read-ahead on ~a: ~d/~s"),
+              stream, num(res), errno_to_string(num(res)), nao);
+  }
+
+  h->ra = ra;
+  stream->co.ops = &rdahead_ops.cobj_ops;
+  return t;
+}
+
+/*
+ * Stop the worker and return the stream to its original operations.
+ * If keep is true, the stream remains usable: characters decoded but
+ * not yet consumed are pushed back, bytes not yet decoded are decoded
+ * here, and a seekable FILE is repositioned to where the worker stopped
+ * reading, so that ordinary stdio input continues seamlessly.
+ */
+static void rdahead_stop(val stream, struct stdio_handle *h, int keep)
+{
+  struct rdahead *ra = h->ra;
+
+  pthread_mutex_lock(&ra->mtx);
+  ra->stop = 1;
+  pthread_cond_broadcast(&ra->cnd);
+  pthread_mutex_unlock(&ra->mtx);
+
+  while (write(ra->wake[1], "", 1) < 0 && errno == EINTR)
+    ;
+
+  pthread_join(ra->thread, 0);
+  close(ra->wake[0]);
+  close(ra->wake[1]);
+  pthread_mutex_destroy(&ra->mtx);
+  pthread_cond_destroy(&ra->cnd);
+
+  h->ra = 0;
+  stream->co.ops = &ra->orig_ops->cobj_ops;
+
+  if (keep) {
+    list_collect_decl (out, ptail);
+    size_t pos = if3(ra->have_cur, ra->pos, 0), nbytes, hold, nch, j;
+    int i, n;
+
+    for (n = ra->nfull, i = ra->rd; n > 0;
+         n--, i = (i + 1) % RDAHEAD_NBLK, pos = 0)
+    {
+      struct rdahead_blk *b = &ra->blk[i];
+      for (j = pos; j < b->fill; j++)
+        ptail = list_collect(ptail, chr(b->data[j]));
+    }
+
+    if (ra->prepos < ra->npre) {
+      nbytes = ra->npre - ra->prepos;
+      ra->raw = coerce(unsigned char *,
+                       chk_realloc(ra->raw, ra->ncarry + nbytes));
+      memcpy(ra->raw + ra->ncarry, ra->pre + ra->prepos, nbytes);
+      ra->ncarry += nbytes;
+    }
+
+    nbytes = ra->ncarry;
+    hold = if3(ra->byte_oriented, 0, utf8_incomplete_tail(ra->raw, nbytes));
+
+    if (nbytes > hold) {
+      wchar_t *wbuf = chk_wmalloc(nbytes - hold);
+      nch = decode_bytes(wbuf, ra->raw, nbytes - hold, ra->byte_oriented);
+      for (j = 0; j < nch; j++)
+        ptail = list_collect(ptail, chr(wbuf[j]));
+      free(wbuf);
+    }
+
+    for (j = nbytes - hold; j < nbytes; j++) {
+      h->ud.buf[h->ud.head] = ra->raw[j];
+      h->ud.head = (h->ud.head + 1) % 8;
+    }
+
+    /* Popping stores the list's young conses into the stream
+       without a write barrier, so note the mutation for the GC. */
+    if (out) {
+      h->unget_c = append2(h->unget_c, out);
+      mut(stream);
+    }
+
+    if (h->f != 0) {
+      off_t off = lseek(ra->fd, 0, SEEK_CUR);
+      if (off >= 0)
+        fseeko(h->f, off, SEEK_SET);
+      clearerr(h->f);
+    }
+  }
+
+  rdahead_free(ra);
+}
+
+/*
+ * Return the block holding the next character, waiting for the worker
+ * as necessary, or null at the end of the data.
+ */
+static struct rdahead_blk *rdahead_cur(val stream, struct stdio_handle *h)
+{
+  struct rdahead *ra = h->ra;
+
+  for (;;) {
+    if (ra->have_cur) {
+      struct rdahead_blk *b = &ra->blk[ra->rd];
+
+      if (ra->pos < b->fill)
+        return b;
+
+      pthread_mutex_lock(&ra->mtx);
+      ra->rd = (ra->rd + 1) % RDAHEAD_NBLK;
+      ra->nfull--;
+      ra->have_cur = 0;
+      pthread_cond_broadcast(&ra->cnd);
+      pthread_mutex_unlock(&ra->mtx);
+    }
+
+    pthread_mutex_lock(&ra->mtx);
+    while (ra->nfull == 0 && !ra->done)
+      pthread_cond_wait(&ra->cnd, &ra->mtx);
+    ra->have_cur = (ra->nfull > 0);
+    pthread_mutex_unlock(&ra->mtx);
+
+    if (!ra->have_cur) {
+      if (ra->err) {
+        h->err = num(ra->err);
+        uw_throwf(file_error_s, lit("error reading ~a: ~d/~s"),
+                  stream, h->err, errno_to_string(h->err), nao);
+      }
+      h->err = t;
+      return 0;
+    }
+
+    ra->pos = 0;
+  }
+}
+
+static val rdahead_get_char(val stream)
+{
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+  struct rdahead_blk *b;
+
+  if (h->unget_c)
+    return rcyc_pop(&h->unget_c);
+
+  if ((b = rdahead_cur(stream, h)) == 0)
+    return nil;
+
+  return chr(b->data[h->ra->pos++]);
+}
+
+static val rdahead_get_line(val stream)
+{
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+  struct rdahead *ra = h->ra;
+  wchar_t *volatile wbuf = 0;
+  size_t size = 0, fill = 0;
+  struct rdahead_blk *b;
+  val out = nil;
+
+  if (h->unget_c)
+    return generic_get_line(stream);
+
+  uw_simple_catch_begin;
+
+  while ((b = rdahead_cur(stream, h)) != 0) {
+    const wchar_t *start = b->data + ra->pos;
+    size_t avail = b->fill - ra->pos;
+    const wchar_t *nl = wmemchr(start, '\n', avail);
+    size_t len = if3(nl, convert(size_t, nl - start), avail);
+
+    if (fill + len + 1 > size) {
+      size_t newsize = if3(size, size * 2, 256);
+      while (newsize < fill + len + 1)
+        newsize *= 2;
+      wbuf = coerce(wchar_t *, chk_grow_vec(coerce(mem_t *, wbuf), size,
+                                            newsize, sizeof *wbuf));
+      size = newsize;
+    }
+
+    wmemcpy(wbuf + fill, start, len);
+    fill += len;
+    ra->pos += len;
+
+    if (nl) {
+      ra->pos++;
+      break;
+    }
+  }
+
+  if (b != 0 || fill > 0) {
+    if (wbuf == 0)
+      wbuf = chk_wmalloc(1);
+    wbuf[fill] = 0;
+    if (fill + 1 < size)
+      wbuf = coerce(wchar_t *, chk_realloc(coerce(mem_t *, wbuf),
+                                           (fill + 1) * sizeof *wbuf));
+    out = string_own(wbuf);
+    wbuf = 0;
+  }
+
+  uw_unwind {
+    free(wbuf);
+  }
+
+  uw_catch_end;
+
+  return out;
+}
+
+static val rdahead_get_string(val stream)
+{
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+  struct rdahead *ra = h->ra;
+  val out = make_string_output_stream();
+  struct rdahead_blk *b;
+
+  while (h->unget_c)
+    put_char(rcyc_pop(&h->unget_c), out);
+
+  while ((b = rdahead_cur(stream, h)) != 0) {
+    size_t len = b->fill - ra->pos;
+    wchar_t *wbuf = chk_wmalloc(len + 1);
+    wmemcpy(wbuf, b->data + ra->pos, len);
+    wbuf[len] = 0;
+    ra->pos += len;
+    put_string(string_own(wbuf), out);
+  }
+
+  return get_string_from_stream(out);
+}
+
+static val rdahead_unget_char(val stream, val ch)
+{
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+  mpush(ch, mkloc(h->unget_c, stream));
+  return ch;
+}
+
+static val rdahead_close(val stream, val throw_on_error)
+{
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+  struct strm_ops *ops = h->ra->orig_ops;
+  rdahead_stop(stream, h, h->f == stdin);
+  return ops->close(stream, throw_on_error);
+}
+
+static val rdahead_get_prop(val stream, val ind)
+{
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+
+  if (ind == pending_k) {
+    struct rdahead *ra = h->ra;
+    int pending;
+
+    if (h->unget_c || (ra->have_cur && ra->pos < ra->blk[ra->rd].fill))
+      return t;
+
+    pthread_mutex_lock(&ra->mtx);
+    pending = ra->nfull > ra->have_cur || ra->done;
+    pthread_mutex_unlock(&ra->mtx);
+    return pending ? t : nil;
+  }
+
+  return h->ra->orig_ops->get_prop(stream, ind);
+}
+
+static val rdahead_set_prop(val stream, val ind, val prop)
+{
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+
+  if (ind == read_ahead_k) {
+    if (!prop)
+      rdahead_stop(stream, h, 1);
+    return t;
+  }
+
+  return h->ra->orig_ops->set_prop(stream, ind, prop);
+}
+
+static val rdahead_get_error_str(val stream)
+{
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+
+  if (h->err == t)
+    return lit("eof");
+
+  return stdio_get_error_str(stream);
+}
+
+static struct strm_ops rdahead_ops =
+  strm_ops_init(cobj_ops_init(eq,
+                              stdio_stream_print,
+                              stdio_stream_destroy,
+                              stdio_stream_mark,
+                              cobj_eq_hash_op),
+                wli("read-ahead-stream"),
+                0, 0, 0,
+                rdahead_get_line,
+                rdahead_get_char,
+                0,
+                rdahead_unget_char,
+                0, 0, 0,
+                rdahead_close,
+                0, 0, 0,
+                rdahead_get_prop,
+                rdahead_set_prop,
+                stdio_get_error,
+                rdahead_get_error_str,
+                stdio_clear_error,
+                stdio_get_fd);
+
+#endif
+
+#if HAVE_SOCKETS
+static struct strm_ops stdio_sock_ops;
+#endif
+
+static void tail_calc(unsigned long *state, int *usec, int *mod)
+{
+  unsigned long count = (*state)++;
+  if (count > 32)
+    count = 32;
+  *usec = 1048576 << (count / 8);
+  *mod = 8 >> (count / 8);
+  if (*mod == 0)
+    *mod = 1;
+}
+
+static void tail_strategy(val stream, unsigned long *state)
+{
+  struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+  int usec = 0, mod = 0;
+  val mode = nil;
+  struct stdio_mode m, m_r = stdio_mode_init_r;
+
+  tail_calc(state, &usec, &mod);
+
+  if (h->is_rotated) {
+    /* We already know that the file has rotated. The caller
+     * has read through to the end of the old open file, and
+     * so we can close it now and open a new file.
+     */
+    fclose(h->f);
+    h->f = 0;
+    h->is_rotated = 0;
+  } else if (h->f != 0) {
+    /* We have a file and it hasn't rotated; so sleep on it. */
+    sig_save_enable;
+    usleep_wrap(num(usec));
+    sig_restore_enable;
+  }
+
+  /* If the state indicates we should poll for a file rotation,
+   * or we have no file ...
+   */
+  if (h->f == 0 || *state % mod == 0) {
+    long save_pos = 0, size;
+
+    if (h->f != 0 && (save_pos = ftell(h->f)) == -1)
+      return;
+
+    for (;;) {
+      FILE *newf;
+
+      if (!mode)
+        mode = normalize_mode(&m, h->mode, m_r);
+
+      /* Try to open the file.
+       */
       if (!(newf = w_fopen(c_str(h->descr), c_str(mode)))) {
         /* If already have the file open previously, and the name
          * does not open any more, then the file has rotated.
@@ -1304,7 +2523,7 @@ static struct strm_ops pipe_ops =
                 stdio_put_string,
                 stdio_put_char,
                 stdio_put_byte,
-                generic_get_line,
+                stdio_get_line,
                 stdio_get_char,
                 stdio_get_byte,
                 stdio_unget_char,
@@ -1497,6 +2716,10 @@ static val make_stdio_stream_common(FILE *f, val descr, struct cobj_ops *ops)
   h->is_real_time = 0;
 #endif
   h->is_byte_oriented = 0;
+  h->is_nonblock = 0;
+  h->is_ibuf = 0;
+  h->ibuf = 0;
+  h->ipos = h->ifill = h->isize = 0;
 #if CONFIG_STDIO_STRICT
   h->last_op = stdio_none;
 #endif
@@ -1505,13 +2728,18 @@ static val make_stdio_stream_common(FILE *f, val descr, struct cobj_ops *ops)
   h->type = nil;
   h->peer = nil;
   h->addr = nil;
+#endif
+#if HAVE_READ_AHEAD
+  h->ra = 0;
 #endif
   return stream;
 }
 
 val make_stdio_stream(FILE *f, val descr)
 {
-  return make_stdio_stream_common(f, descr, &stdio_ops.cobj_ops);
+  val stream = make_stdio_stream_common(f, descr, &stdio_ops.cobj_ops);
+  stdio_ibuf_init(coerce(struct stdio_handle *, stream->co.handle));
+  return stream;
 }
 
 val make_tail_stream(FILE *f, val descr)
@@ -1523,7 +2751,9 @@ val make_tail_stream(FILE *f, val descr)
 
 val make_pipe_stream(FILE *f, val descr)
 {
-  return make_stdio_stream_common(f, descr, &pipe_ops.cobj_ops);
+  val stream = make_stdio_stream_common(f, descr, &pipe_ops.cobj_ops);
+  stdio_ibuf_init(coerce(struct stdio_handle *, stream->co.handle));
+  return stream;
 }
 
 #if HAVE_SOCKETS
@@ -1533,6 +2763,7 @@ val make_sock_stream(FILE *f, val family, val type)
   struct stdio_handle *h = coerce(struct stdio_handle *, s->co.handle);
   h->family = family;
   h->type = type;
+  stdio_ibuf_init(h);
   return s;
 }
 #endif
@@ -1575,6 +2806,7 @@ static val make_pipevp_stream(FILE *f, val descr, pid_t pid)
   val stream = make_stdio_stream_common(f, descr, &pipe_ops.cobj_ops);
   struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
   h->pid = pid;
+  stdio_ibuf_init(h);
   return stream;
 }
 #endif
@@ -2573,145 +3805,1173 @@ static val delegate_truncate(val stream, val len)
   return s->target_ops->truncate(s->target_stream, len);
 }
 
-static val delegate_get_prop(val stream, val ind)
+static val delegate_get_prop(val stream, val ind)
+{
+  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
+  return s->target_ops->get_prop(s->target_stream, ind);
+}
+
+static val delegate_set_prop(val stream, val ind, val value)
+{
+  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
+  return s->target_ops->set_prop(s->target_stream, ind, value);
+}
+
+static val delegate_get_error(val stream)
+{
+  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
+  return s->target_ops->get_error(s->target_stream);
+}
+
+static val delegate_get_error_str(val stream)
+{
+  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
+  return s->target_ops->get_error_str(s->target_stream);
+}
+
+static val delegate_clear_error(val stream)
+{
+  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
+  return s->target_ops->clear_error(s->target_stream);
+}
+
+static val delegate_get_fd(val stream)
+{
+  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
+  return s->target_ops->get_fd(s->target_stream);
+}
+
+#if HAVE_SOCKETS
+
+static val delegate_get_sock_family(val stream)
+{
+  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
+  return s->target_ops->get_sock_family(s->target_stream);
+}
+
+static val delegate_get_sock_type(val stream)
+{
+  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
+  return s->target_ops->get_sock_type(s->target_stream);
+}
+
+static val delegate_get_sock_peer(val stream)
+{
+  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
+  return s->target_ops->get_sock_peer(s->target_stream);
+}
+
+static val delegate_set_sock_peer(val stream, val peer)
+{
+  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
+  return s->target_ops->set_sock_peer(s->target_stream, peer);
+}
+
+#endif
+
+static val make_delegate_stream(val orig_stream, size_t handle_size,
+                                struct cobj_ops *ops)
+{
+  struct strm_ops *orig_ops = coerce(struct strm_ops *,
+                                     cobj_ops(orig_stream, stream_s));
+  struct delegate_base *db = coerce(struct delegate_base *,
+                                    chk_calloc(1, handle_size));
+  val delegate_stream;
+
+  strm_base_init(&db->a);
+  db->target_stream = nil;
+  db->target_ops = orig_ops;
+
+  delegate_stream = cobj(coerce(mem_t *, db), stream_s, ops);
+
+  db->target_stream = orig_stream;
+
+  return delegate_stream;
+}
+
+struct ibuf_put {
+  unsigned char *p;
+  size_t n;
+};
+
+static int stdio_ibuf_put(int ch, mem_t *ctx)
+{
+  struct ibuf_put *ip = coerce(struct ibuf_put *, ctx);
+  if (ip->p)
+    ip->p[ip->n] = ch;
+  ip->n++;
+  return 1;
+}
+
+static void stdio_ibuf_encode(struct stdio_handle *h, struct ibuf_put *ip,
+                              const wchar_t *str, cnum n)
+{
+  cnum i;
+
+  for (i = 0; i < n; i++) {
+    if (h->is_byte_oriented)
+      stdio_ibuf_put(str[i] & 0xFF, coerce(mem_t *, ip));
+    else
+      utf8_encode(str[i], stdio_ibuf_put, coerce(mem_t *, ip));
+  }
+}
+
+/*
+ * Return characters to a stdio stream with its own input buffer by
+ * encoding them back into bytes at the front of the buffer, so that byte
+ * input and fill-buf see them too. Not possible if characters have
+ * already been pushed back or the decoder holds bytes; those must be
+ * consumed first.
+ */
+static int stdio_ibuf_unget_chars(struct stdio_handle *h,
+                                  const wchar_t *str, cnum n)
+{
+  struct ibuf_put ip = { 0, 0 };
+
+  if (!h->is_ibuf || h->f == 0 || h->unget_c || h->ud.tail != h->ud.head)
+    return 0;
+
+  stdio_ibuf_encode(h, &ip, str, n);
+
+  if (h->ipos < ip.n) {
+    size_t avail = h->ifill - h->ipos, nsize = h->isize;
+    unsigned char *nbuf;
+
+    while (nsize < avail + ip.n)
+      nsize = if3(nsize, nsize * 2, STDIO_IBUF_SIZE);
+
+    nbuf = coerce(unsigned char *, chk_malloc(nsize));
+    if (avail > 0)
+      memcpy(nbuf + ip.n, h->ibuf + h->ipos, avail);
+    free(h->ibuf);
+    h->ibuf = nbuf;
+    h->isize = nsize;
+    h->ipos = ip.n;
+    h->ifill = ip.n + avail;
+  }
+
+  h->ipos -= ip.n;
+  ip.p = h->ibuf + h->ipos;
+  ip.n = 0;
+  stdio_ibuf_encode(h, &ip, str, n);
+
+  if (h->err == t)
+    h->err = nil;
+
+  return 1;
+}
+
+#if HAVE_ZLIB || HAVE_ZSTD
+static struct strm_ops decompress_ops;
+static cnum zstrm_get_chars_avail(val stream, wchar_t *buf,
+                                  cnum n, cnum size);
+#endif
+
+/*
+ * Read up to size characters into buf. Only the first character may wait
+ * for input; after that, only what the stream already has on hand is
+ * taken, so that input is never awaited beyond what a producer on a pipe
+ * or socket has sent. Streams which don't block are read up to size.
+ * Returns the number of characters read, zero at the end of input.
+ */
+cnum get_chars_avail(val stream, wchar_t *buf, cnum size)
+{
+  struct strm_ops *ops = coerce(struct strm_ops *, cobj_ops(stream, stream_s));
+  cnum n = 0;
+  val ch;
+
+  if (size <= 0 || (ch = ops->get_char(stream)) == nil)
+    return 0;
+
+  buf[n++] = c_chr(ch);
+
+  if (ops->get_char == stdio_get_char) {
+    struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+
+    if (!h->is_ibuf) {
+      while (n < size && (ch = stdio_get_char(stream)) != nil)
+        buf[n++] = c_chr(ch);
+      return n;
+    }
+
+    while (n < size && h->unget_c)
+      buf[n++] = c_chr(rcyc_pop(&h->unget_c));
+
+    while (n < size && h->f != 0 && h->ipos < h->ifill) {
+      wint_t wch;
+
+      if (h->is_byte_oriented) {
+        wch = h->ibuf[h->ipos++];
+        buf[n++] = if3(wch == 0, 0xDC00, wch);
+        continue;
+      }
+
+      if (h->ud.tail != h->ud.head ||
+          h->ifill - h->ipos < utf8_seq_len(h->ibuf[h->ipos]))
+        break;
+
+      if ((wch = utf8_decode(&h->ud, stdio_ibuf_get,
+                             coerce(mem_t *, h))) == WEOF)
+        break;
+
+      buf[n++] = wch;
+    }
+#if HAVE_READ_AHEAD
+  } else if (ops == &rdahead_ops) {
+    struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+    struct rdahead *ra = h->ra;
+
+    while (n < size && h->unget_c)
+      buf[n++] = c_chr(rcyc_pop(&h->unget_c));
+
+    if (ra->have_cur) {
+      struct rdahead_blk *b = &ra->blk[ra->rd];
+      size_t avail = b->fill - ra->pos;
+      size_t take = if3(avail < convert(size_t, size - n),
+                        avail, convert(size_t, size - n));
+      wmemcpy(buf + n, b->data + ra->pos, take);
+      ra->pos += take;
+      n += take;
+    }
+#endif
+#if HAVE_ZLIB || HAVE_ZSTD
+  } else if (ops == &decompress_ops) {
+    n = zstrm_get_chars_avail(stream, buf, n, size);
+#endif
+  } else if (ops == &string_in_ops) {
+    while (n < size && (ch = ops->get_char(stream)) != nil)
+      buf[n++] = c_chr(ch);
+  }
+
+  return n;
+}
+
+/*
+ * Push back n characters, so that they are read again in order.
+ */
+void unget_chars(val stream, const wchar_t *str, cnum n)
+{
+  struct strm_ops *ops = coerce(struct strm_ops *, cobj_ops(stream, stream_s));
+
+  if (n <= 0)
+    return;
+
+  if (ops->get_char == stdio_get_char &&
+      stdio_ibuf_unget_chars(coerce(struct stdio_handle *,
+                                    stream->co.handle), str, n))
+  {
+    return;
+  }
+
+  while (n > 0)
+    ops->unget_char(stream, chr(str[--n]));
+}
+
+struct record_adapter_base {
+  struct delegate_base db;
+  val regex;
+  val include_match;
+  struct rec_buf rbuf;
+};
+
+static void record_adapter_base_mark(struct record_adapter_base *rb)
+{
+  delegate_base_mark(&rb->db);
+  gc_mark(rb->regex);
+}
+
+static void record_adapter_mark_op(val stream)
+{
+  struct record_adapter_base *rb = coerce(struct record_adapter_base *,
+                                         stream->co.handle);
+  record_adapter_base_mark(rb);
+}
+
+static void record_adapter_destroy_op(val stream)
+{
+  struct record_adapter_base *rb = coerce(struct record_adapter_base *,
+                                         stream->co.handle);
+  free(rb->rbuf.data);
+  rb->rbuf.data = 0;
+  stream_destroy_op(stream);
+}
+
+/*
+ * Characters read ahead of the current record are returned to the
+ * target stream before any operation other than record or character
+ * input is delegated to it.
+ */
+static struct record_adapter_base *record_adapter_sync(val stream)
+{
+  struct record_adapter_base *rb = coerce(struct record_adapter_base *,
+                                         stream->co.handle);
+  if (rb->rbuf.data != 0)
+    rec_buf_unget(&rb->rbuf, rb->db.target_stream);
+  return rb;
+}
+
+static val record_adapter_get_line(val stream)
+{
+  struct record_adapter_base *rb = coerce(struct record_adapter_base *,
+                                         stream->co.handle);
+  return read_until_match_buf(rb->regex, rb->db.target_stream,
+                              rb->include_match, &rb->rbuf, 1);
+}
+
+static val record_adapter_get_char(val stream)
+{
+  struct record_adapter_base *rb = coerce(struct record_adapter_base *,
+                                         stream->co.handle);
+  if (rb->rbuf.start < rb->rbuf.end)
+    return chr(rb->rbuf.data[rb->rbuf.start++]);
+  return delegate_get_char(stream);
+}
+
+static val record_adapter_get_byte(val stream)
+{
+  record_adapter_sync(stream);
+  return delegate_get_byte(stream);
+}
+
+static val record_adapter_unget_char(val stream, val ch)
+{
+  record_adapter_sync(stream);
+  return delegate_unget_char(stream, ch);
+}
+
+static val record_adapter_unget_byte(val stream, int byte)
+{
+  record_adapter_sync(stream);
+  return delegate_unget_byte(stream, byte);
+}
+
+static val record_adapter_fill_buf(val stream, val buf, cnum pos)
+{
+  record_adapter_sync(stream);
+  return delegate_fill_buf(stream, buf, pos);
+}
+
+static val record_adapter_seek(val stream, val off, enum strm_whence whence)
+{
+  record_adapter_sync(stream);
+  return delegate_seek(stream, off, whence);
+}
+
+static val record_adapter_close(val stream, val throw_on_error)
+{
+  struct record_adapter_base *rb = coerce(struct record_adapter_base *,
+                                         stream->co.handle);
+  free(rb->rbuf.data);
+  memset(&rb->rbuf, 0, sizeof rb->rbuf);
+  return delegate_close(stream, throw_on_error);
+}
+
+static val record_adapter_get_error(val stream)
+{
+  struct record_adapter_base *rb = coerce(struct record_adapter_base *,
+                                         stream->co.handle);
+  if (rb->rbuf.start < rb->rbuf.end)
+    return nil;
+  return delegate_get_error(stream);
+}
+
+static struct strm_ops record_adapter_ops =
+  strm_ops_init(cobj_ops_init(eq,
+                              stream_print_op,
+                              record_adapter_destroy_op,
+                              record_adapter_mark_op,
+                              cobj_eq_hash_op),
+                wli("record-adapter"),
+                delegate_put_string, delegate_put_char, delegate_put_byte,
+                record_adapter_get_line, record_adapter_get_char,
+                record_adapter_get_byte,
+                record_adapter_unget_char, record_adapter_unget_byte,
+                delegate_put_buf, record_adapter_fill_buf,
+                record_adapter_close, delegate_flush, record_adapter_seek,
+                delegate_truncate, delegate_get_prop, delegate_set_prop,
+                record_adapter_get_error, delegate_get_error_str,
+                delegate_clear_error, delegate_get_fd);
+
+val record_adapter(val regex, val stream, val include_match)
+{
+  val rec_adapter = make_delegate_stream(default_arg(stream, std_input),
+                                         sizeof (struct record_adapter_base),
+                                         &record_adapter_ops.cobj_ops);
+  struct record_adapter_base *rb = coerce(struct record_adapter_base *,
+                                          rec_adapter->co.handle);
+
+  rb->regex = regex;
+  rb->include_match = default_null_arg(include_match);
+  return rec_adapter;
+}
+
+#if HAVE_ZLIB || HAVE_ZSTD
+
+#define ZSTRM_BUFSIZE 65536
+
+enum zstrm_fmt { zfmt_auto, zfmt_gzip, zfmt_zlib, zfmt_zstd };
+
+enum zstrm_flush { zflush_none, zflush_sync, zflush_finish };
+
+struct zstrm {
+  struct delegate_base db;
+  enum zstrm_fmt fmt;
+  unsigned is_output : 8;
+  unsigned is_open : 8;
+  unsigned in_eof : 8;
+  unsigned at_end : 8;
+  unsigned more_out : 8;
+#if HAVE_ZLIB
+  z_stream z;
+#endif
+#if HAVE_ZSTD
+  ZSTD_DStream *zd;
+  ZSTD_CStream *zc;
+#endif
+  unsigned char *cbuf, *dbuf;
+  size_t cpos, cfill, dpos, dfill;
+  val unget_c;
+  utf8_decoder_t ud;
+  val err;
+};
+
+static void zstrm_release(struct zstrm *zs)
+{
+  if (zs->is_open) {
+    switch (zs->fmt) {
+#if HAVE_ZLIB
+    case zfmt_gzip:
+    case zfmt_zlib:
+      if (zs->is_output)
+        deflateEnd(&zs->z);
+      else
+        inflateEnd(&zs->z);
+      break;
+#endif
+#if HAVE_ZSTD
+    case zfmt_zstd:
+      if (zs->is_output)
+        ZSTD_freeCStream(zs->zc);
+      else
+        ZSTD_freeDStream(zs->zd);
+      break;
+#endif
+    default:
+      break;
+    }
+    zs->is_open = 0;
+  }
+
+  free(zs->cbuf);
+  free(zs->dbuf);
+  zs->cbuf = zs->dbuf = 0;
+  zs->cpos = zs->cfill = zs->dpos = zs->dfill = 0;
+}
+
+static void zstrm_mark_op(val stream)
+{
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
+  delegate_base_mark(&zs->db);
+  gc_mark(zs->unget_c);
+  gc_mark(zs->err);
+}
+
+static void zstrm_destroy_op(val stream)
+{
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
+  zstrm_release(zs);
+  stream_destroy_op(stream);
+}
+
+static noreturn void zstrm_error(val stream, const char *msg)
+{
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
+  val str = string_utf8(msg ? msg : "unknown error");
+  set(mkloc(zs->err, stream), str);
+  uw_throwf(file_error_s, lit("error ~a ~a: ~a"),
+            if3(zs->is_output, lit("compressing"), lit("decompressing")),
+            stream, str, nao);
+}
+
+static void zstrm_open(val stream, struct zstrm *zs, enum zstrm_fmt fmt,
+                       int level)
+{
+  zs->fmt = fmt;
+
+  switch (fmt) {
+#if HAVE_ZLIB
+  case zfmt_gzip:
+  case zfmt_zlib:
+    {
+      int bits = if3(fmt == zfmt_gzip, 15 + 16, 15);
+      int ret = if3(zs->is_output,
+                    deflateInit2(&zs->z, level, Z_DEFLATED, bits, 8,
+                                 Z_DEFAULT_STRATEGY),
+                    inflateInit2(&zs->z, 15 + 32));
+      if (ret != Z_OK)
+        zstrm_error(stream, zs->z.msg);
+    }
+    break;
+#endif
+#if HAVE_ZSTD
+  case zfmt_zstd:
+    if (zs->is_output) {
+      size_t ret;
+      if ((zs->zc = ZSTD_createCStream()) == 0)
+        zstrm_error(stream, "unable to create zstd context");
+      ret = ZSTD_CCtx_setParameter(zs->zc, ZSTD_c_compressionLevel, level);
+      if (ZSTD_isError(ret)) {
+        ZSTD_freeCStream(zs->zc);
+        zstrm_error(stream, ZSTD_getErrorName(ret));
+      }
+    } else if ((zs->zd = ZSTD_createDStream()) == 0) {
+      zstrm_error(stream, "unable to create zstd context");
+    }
+    break;
+#endif
+  default:
+    uw_throwf(file_error_s, lit("~a: compression format not supported"),
+              stream, nao);
+  }
+
+  zs->is_open = 1;
+}
+
+static int zstrm_read(struct zstrm *zs)
+{
+  val buf = make_borrowed_buf(num_fast(ZSTRM_BUFSIZE), zs->cbuf);
+  cnum nread = c_num(zs->db.target_ops->fill_buf(zs->db.target_stream,
+                                                 buf, 0));
+  zs->cpos = 0;
+  zs->cfill = nread;
+  if (nread <= 0) {
+    zs->cfill = 0;
+    zs->in_eof = 1;
+  }
+  return zs->cfill > 0;
+}
+
+static void zstrm_write(val stream, struct zstrm *zs, size_t size)
+{
+  val buf = make_borrowed_buf(unum(size), zs->cbuf);
+  cnum pos = 0;
+
+  while (convert(size_t, pos) < size) {
+    cnum npos = c_num(zs->db.target_ops->put_buf(zs->db.target_stream,
+                                                 buf, pos));
+    if (npos <= pos)
+      zstrm_error(stream, "unable to write compressed data");
+    pos = npos;
+  }
+}
+
+/*
+ * Recognize the input format from the zstd frame magic number;
+ * anything else is handed to zlib, which accepts both the gzip
+ * and the zlib header.
+ */
+static enum zstrm_fmt zstrm_detect(struct zstrm *zs)
+{
+  const unsigned char *p = zs->cbuf + zs->cpos;
+  if (zs->cfill - zs->cpos >= 4 &&
+      p[0] == 0x28 && p[1] == 0xB5 && p[2] == 0x2F && p[3] == 0xFD)
+    return zfmt_zstd;
+  return zfmt_gzip;
+}
+
+static void zstrm_decode_step(val stream, struct zstrm *zs)
+{
+  switch (zs->fmt) {
+#if HAVE_ZLIB
+  case zfmt_gzip:
+  case zfmt_zlib:
+    {
+      int ret;
+
+      zs->z.next_in = zs->cbuf + zs->cpos;
+      zs->z.avail_in = zs->cfill - zs->cpos;
+      zs->z.next_out = zs->dbuf;
+      zs->z.avail_out = ZSTRM_BUFSIZE;
+
+      ret = inflate(&zs->z, Z_NO_FLUSH);
+
+      zs->cpos = zs->cfill - zs->z.avail_in;
+      zs->dfill = ZSTRM_BUFSIZE - zs->z.avail_out;
+      zs->more_out = (zs->z.avail_out == 0);
+
+      switch (ret) {
+      case Z_STREAM_END:
+        /* Concatenated gzip members are decoded as one stream. */
+        inflateReset(&zs->z);
+        zs->at_end = 1;
+        break;
+      case Z_OK:
+        zs->at_end = 0;
+        break;
+      case Z_BUF_ERROR:
+        break;
+      default:
+        zstrm_error(stream, zs->z.msg);
+      }
+    }
+    break;
+#endif
+#if HAVE_ZSTD
+  case zfmt_zstd:
+    {
+      ZSTD_inBuffer in;
+      ZSTD_outBuffer out;
+      size_t ret;
+
+      in.src = zs->cbuf + zs->cpos;
+      in.size = zs->cfill - zs->cpos;
+      in.pos = 0;
+      out.dst = zs->dbuf;
+      out.size = ZSTRM_BUFSIZE;
+      out.pos = 0;
+
+      ret = ZSTD_decompressStream(zs->zd, &out, &in);
+
+      if (ZSTD_isError(ret))
+        zstrm_error(stream, ZSTD_getErrorName(ret));
+
+      zs->cpos += in.pos;
+      zs->dfill = out.pos;
+      zs->more_out = (out.pos == out.size);
+      zs->at_end = (ret == 0);
+    }
+    break;
+#endif
+  default:
+    break;
+  }
+}
+
+/*
+ * Decompress the next block of data into dbuf. Returns zero at the end
+ * of the data, which must coincide with the end of a complete gzip
+ * member or zstd frame.
+ */
+static int zstrm_refill(val stream, struct zstrm *zs)
+{
+  if (!zs->is_open) {
+    if (zs->fmt != zfmt_auto || zs->dbuf == 0)
+      return 0;
+    if (!zstrm_read(zs)) {
+      zs->err = t;
+      return 0;
+    }
+    zstrm_open(stream, zs, zstrm_detect(zs), 0);
+  }
+
+  zs->dpos = zs->dfill = 0;
+
+  while (zs->dfill == 0) {
+    if (zs->cpos == zs->cfill && !zs->more_out && !zstrm_read(zs)) {
+      if (!zs->at_end)
+        zstrm_error(stream, "unexpected end of compressed data");
+      zs->err = t;
+      return 0;
+    }
+
+    zstrm_decode_step(stream, zs);
+  }
+
+  return 1;
+}
+
+static int zstrm_get_byte_callback(mem_t *ctx)
+{
+  val stream = coerce(val, ctx);
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
+
+  if (zs->dpos == zs->dfill && !zstrm_refill(stream, zs))
+    return EOF;
+  return zs->dbuf[zs->dpos++];
+}
+
+static val zstrm_get_char(val stream)
+{
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
+  wint_t ch;
+
+  if (zs->unget_c)
+    return rcyc_pop(&zs->unget_c);
+
+  ch = utf8_decode(&zs->ud, zstrm_get_byte_callback, coerce(mem_t *, stream));
+  return (ch != WEOF) ? chr(ch) : nil;
+}
+
+static val zstrm_get_byte(val stream)
+{
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
+
+  if (zs->dpos == zs->dfill && !zstrm_refill(stream, zs))
+    return nil;
+  return num_fast(zs->dbuf[zs->dpos++]);
+}
+
+static val zstrm_get_line(val stream)
+{
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
+  unsigned char *volatile bytes = 0;
+  wchar_t *volatile wbuf = 0;
+  size_t size = 0, fill = 0;
+  val out = nil;
+
+  if (zs->unget_c || zs->ud.tail != zs->ud.head)
+    return generic_get_line(stream);
+
+  uw_simple_catch_begin;
+
+  for (;;) {
+    unsigned char *start, *nl;
+    size_t len;
+
+    if (zs->dpos == zs->dfill && !zstrm_refill(stream, zs)) {
+      if (fill > 0)
+        wbuf = decode_line_bytes(bytes, fill, 0);
+      break;
+    }
+
+    start = zs->dbuf + zs->dpos;
+    nl = coerce(unsigned char *, memchr(start, '\n', zs->dfill - zs->dpos));
+    len = if3(nl, nl - start, zs->dfill - zs->dpos);
+
+    if (nl && fill == 0) {
+      wbuf = decode_line_bytes(start, len, 0);
+      zs->dpos += len + 1;
+      break;
+    }
+
+    if (fill + len > size) {
+      size_t newsize = size ? size * 2 : 256;
+      while (newsize < fill + len)
+        newsize *= 2;
+      bytes = coerce(unsigned char *, chk_grow_vec(coerce(mem_t *, bytes),
+                                                   size, newsize, 1));
+      size = newsize;
+    }
+
+    memcpy(bytes + fill, start, len);
+    fill += len;
+    zs->dpos += len;
+
+    if (nl) {
+      wbuf = decode_line_bytes(bytes, fill, 0);
+      zs->dpos++;
+      break;
+    }
+  }
+
+  if (wbuf) {
+    out = string_own(wbuf);
+    wbuf = 0;
+  }
+
+  uw_unwind {
+    free(bytes);
+    free(wbuf);
+  }
+
+  uw_catch_end;
+
+  return out;
+}
+
+static val zstrm_unget_char(val stream, val ch)
+{
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
+  mpush(ch, mkloc(zs->unget_c, stream));
+  return ch;
+}
+
+static val zstrm_unget_byte(val stream, int byte)
+{
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
+
+  if (zs->dpos == 0)
+    uw_throwf(file_error_s,
+              lit("unget-byte: cannot push back byte into ~a"), stream, nao);
+
+  zs->dbuf[--zs->dpos] = byte;
+  return num_fast(byte);
+}
+
+static val zstrm_fill_buf(val stream, val buf, cnum pos)
+{
+  val self = lit("fill-buf");
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
+  cnum len = c_num(length_buf(buf));
+  mem_t *ptr = buf_get(buf, self);
+
+  while (pos < len) {
+    size_t avail, size = len - pos;
+
+    if (zs->dpos == zs->dfill && !zstrm_refill(stream, zs))
+      break;
+
+    avail = zs->dfill - zs->dpos;
+    if (size > avail)
+      size = avail;
+
+    memcpy(ptr + pos, zs->dbuf + zs->dpos, size);
+    zs->dpos += size;
+    pos += size;
+  }
+
+  return num(pos);
+}
+
+/*
+ * Compress the bytes accumulated in dbuf, passing the output
+ * to the target stream.
+ */
+static void zstrm_encode(val stream, struct zstrm *zs, enum zstrm_flush flush)
+{
+  switch (zs->fmt) {
+#if HAVE_ZLIB
+  case zfmt_gzip:
+  case zfmt_zlib:
+    {
+      int zflush = if3(flush == zflush_finish, Z_FINISH,
+                       if3(flush == zflush_sync, Z_SYNC_FLUSH, Z_NO_FLUSH));
+
+      zs->z.next_in = zs->dbuf;
+      zs->z.avail_in = zs->dfill;
+
+      for (;;) {
+        int ret;
+
+        zs->z.next_out = zs->cbuf;
+        zs->z.avail_out = ZSTRM_BUFSIZE;
+
+        ret = deflate(&zs->z, zflush);
+
+        if (ret == Z_STREAM_ERROR)
+          zstrm_error(stream, zs->z.msg);
+
+        zstrm_write(stream, zs, ZSTRM_BUFSIZE - zs->z.avail_out);
+
+        if (zflush == Z_FINISH ? ret == Z_STREAM_END : zs->z.avail_out != 0)
+          break;
+      }
+    }
+    break;
+#endif
+#if HAVE_ZSTD
+  case zfmt_zstd:
+    {
+      ZSTD_EndDirective mode = if3(flush == zflush_finish, ZSTD_e_end,
+                                   if3(flush == zflush_sync,
+                                       ZSTD_e_flush, ZSTD_e_continue));
+      ZSTD_inBuffer in;
+
+      in.src = zs->dbuf;
+      in.size = zs->dfill;
+      in.pos = 0;
+
+      for (;;) {
+        ZSTD_outBuffer out;
+        size_t ret;
+
+        out.dst = zs->cbuf;
+        out.size = ZSTRM_BUFSIZE;
+        out.pos = 0;
+
+        ret = ZSTD_compressStream2(zs->zc, &out, &in, mode);
+
+        if (ZSTD_isError(ret))
+          zstrm_error(stream, ZSTD_getErrorName(ret));
+
+        zstrm_write(stream, zs, out.pos);
+
+        if (mode == ZSTD_e_continue ? in.pos == in.size : ret == 0)
+          break;
+      }
+    }
+    break;
+#endif
+  default:
+    break;
+  }
+
+  zs->dfill = 0;
+}
+
+static struct zstrm *zstrm_out_handle(val stream)
+{
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
+  if (!zs->is_open)
+    uw_throwf(file_error_s, lit("error writing ~a: stream closed"),
+              stream, nao);
+  return zs;
+}
+
+static val zstrm_put_byte(val stream, int byte)
+{
+  struct zstrm *zs = zstrm_out_handle(stream);
+  if (zs->dfill == ZSTRM_BUFSIZE)
+    zstrm_encode(stream, zs, zflush_none);
+  zs->dbuf[zs->dfill++] = byte;
+  return t;
+}
+
+static int zstrm_put_byte_callback(int ch, mem_t *ctx)
 {
-  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
-  return s->target_ops->get_prop(s->target_stream, ind);
+  zstrm_put_byte(coerce(val, ctx), ch);
+  return 1;
 }
 
-static val delegate_set_prop(val stream, val ind, val value)
+static val zstrm_put_string(val stream, val str)
 {
-  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
-  return s->target_ops->set_prop(s->target_stream, ind, value);
+  struct zstrm *zs = zstrm_out_handle(stream);
+  const wchar_t *s = c_str(str);
+  size_t len = c_num(length_str(str));
+
+  while (len > 0) {
+    size_t nchar;
+
+    if (ZSTRM_BUFSIZE - zs->dfill < 8)
+      zstrm_encode(stream, zs, zflush_none);
+
+    zs->dfill += utf8_encode_buf(zs->dbuf + zs->dfill,
+                                 ZSTRM_BUFSIZE - zs->dfill, s, len, &nchar);
+
+    if (nchar == 0) {
+      utf8_encode(*s, zstrm_put_byte_callback, coerce(mem_t *, stream));
+      nchar = 1;
+    }
+
+    s += nchar;
+    len -= nchar;
+  }
+
+  return t;
 }
 
-static val delegate_get_error(val stream)
+static val zstrm_put_char(val stream, val ch)
 {
-  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
-  return s->target_ops->get_error(s->target_stream);
+  (void) zstrm_out_handle(stream);
+  utf8_encode(c_chr(ch), zstrm_put_byte_callback, coerce(mem_t *, stream));
+  return t;
 }
 
-static val delegate_get_error_str(val stream)
+static val zstrm_put_buf(val stream, val buf, cnum pos)
 {
-  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
-  return s->target_ops->get_error_str(s->target_stream);
+  val self = lit("put-buf");
+  struct zstrm *zs = zstrm_out_handle(stream);
+  cnum len = c_num(length_buf(buf));
+  mem_t *ptr = buf_get(buf, self);
+
+  while (pos < len) {
+    size_t size = len - pos;
+
+    if (zs->dfill == ZSTRM_BUFSIZE)
+      zstrm_encode(stream, zs, zflush_none);
+
+    if (size > ZSTRM_BUFSIZE - zs->dfill)
+      size = ZSTRM_BUFSIZE - zs->dfill;
+
+    memcpy(zs->dbuf + zs->dfill, ptr + pos, size);
+    zs->dfill += size;
+    pos += size;
+  }
+
+  return num(len);
 }
 
-static val delegate_clear_error(val stream)
+static val zstrm_flush(val stream)
 {
-  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
-  return s->target_ops->clear_error(s->target_stream);
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
+
+  if (zs->is_output && zs->is_open) {
+    zstrm_encode(stream, zs, zflush_sync);
+    return delegate_flush(stream);
+  }
+
+  return t;
 }
 
-static val delegate_get_fd(val stream)
+static val zstrm_close(val stream, val throw_on_error)
 {
-  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
-  return s->target_ops->get_fd(s->target_stream);
-}
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
 
-#if HAVE_SOCKETS
+  if (zs->dbuf == 0)
+    return nil;
 
-static val delegate_get_sock_family(val stream)
-{
-  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
-  return s->target_ops->get_sock_family(s->target_stream);
+  if (zs->is_output && zs->is_open)
+    zstrm_encode(stream, zs, zflush_finish);
+
+  zstrm_release(zs);
+  return delegate_close(stream, throw_on_error);
 }
 
-static val delegate_get_sock_type(val stream)
+static val zstrm_get_error(val stream)
 {
-  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
-  return s->target_ops->get_sock_type(s->target_stream);
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
+  return zs->err;
 }
 
-static val delegate_get_sock_peer(val stream)
+static val zstrm_get_error_str(val stream)
 {
-  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
-  return s->target_ops->get_sock_peer(s->target_stream);
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
+
+  if (zs->err == t)
+    return lit("eof");
+  if (stringp(zs->err))
+    return zs->err;
+  return lit("no error");
 }
 
-static val delegate_set_sock_peer(val stream, val peer)
+static val zstrm_clear_error(val stream)
 {
-  struct delegate_base *s = coerce(struct delegate_base *, stream->co.handle);
-  return s->target_ops->set_sock_peer(s->target_stream, peer);
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
+  val ret = zs->err;
+  zs->err = nil;
+  return ret;
 }
 
-#endif
+/*
+ * The properties of the compressed stream underneath don't describe the
+ * data read or written here: there is no descriptor for it, and pending
+ * input is what has been decompressed but not yet consumed.
+ */
+static val zstrm_get_prop(val stream, val ind)
+{
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
 
-static val make_delegate_stream(val orig_stream, size_t handle_size,
-                                struct cobj_ops *ops)
+  if (ind == fd_k)
+    return nil;
+  if (ind == pending_k)
+    return tnil(zs->unget_c || zs->ud.tail != zs->ud.head ||
+                zs->dpos < zs->dfill || zs->more_out);
+  return delegate_get_prop(stream, ind);
+}
+
+static val zstrm_get_fd(val stream)
 {
-  struct strm_ops *orig_ops = coerce(struct strm_ops *,
-                                     cobj_ops(orig_stream, stream_s));
-  struct delegate_base *db = coerce(struct delegate_base *,
-                                    chk_calloc(1, handle_size));
-  val delegate_stream;
+  (void) stream;
+  return nil;
+}
 
-  strm_base_init(&db->a);
-  db->target_stream = nil;
-  db->target_ops = orig_ops;
+/*
+ * The part of get_chars_avail which takes characters decompressed but
+ * not yet consumed, without decompressing more.
+ */
+static cnum zstrm_get_chars_avail(val stream, wchar_t *buf,
+                                  cnum n, cnum size)
+{
+  struct zstrm *zs = coerce(struct zstrm *, stream->co.handle);
 
-  delegate_stream = cobj(coerce(mem_t *, db), stream_s, ops);
+  while (n < size && zs->unget_c)
+    buf[n++] = c_chr(rcyc_pop(&zs->unget_c));
 
-  db->target_stream = orig_stream;
+  while (n < size && zs->dpos < zs->dfill &&
+         zs->ud.tail == zs->ud.head &&
+         zs->dfill - zs->dpos >= utf8_seq_len(zs->dbuf[zs->dpos]))
+  {
+    buf[n++] = utf8_decode(&zs->ud, zstrm_get_byte_callback,
+                           coerce(mem_t *, stream));
+  }
 
-  return delegate_stream;
+  return n;
 }
 
-struct record_adapter_base {
-  struct delegate_base db;
-  val regex;
-  val include_match;
-};
+static struct strm_ops decompress_ops =
+  strm_ops_init(cobj_ops_init(eq,
+                              stream_print_op,
+                              zstrm_destroy_op,
+                              zstrm_mark_op,
+                              cobj_eq_hash_op),
+                wli("decompress-stream"),
+                0, 0, 0,
+                zstrm_get_line, zstrm_get_char, zstrm_get_byte,
+                zstrm_unget_char, zstrm_unget_byte,
+                0, zstrm_fill_buf,
+                zstrm_close, zstrm_flush, 0, 0,
+                zstrm_get_prop, delegate_set_prop,
+                zstrm_get_error, zstrm_get_error_str,
+                zstrm_clear_error, zstrm_get_fd);
+
+static struct strm_ops compress_ops =
+  strm_ops_init(cobj_ops_init(eq,
+                              stream_print_op,
+                              zstrm_destroy_op,
+                              zstrm_mark_op,
+                              cobj_eq_hash_op),
+                wli("compress-stream"),
+                zstrm_put_string, zstrm_put_char, zstrm_put_byte,
+                0, 0, 0, 0, 0,
+                zstrm_put_buf, 0,
+                zstrm_close, zstrm_flush, 0, 0,
+                zstrm_get_prop, delegate_set_prop,
+                zstrm_get_error, zstrm_get_error_str,
+                zstrm_clear_error, zstrm_get_fd);
 
-static void record_adapter_base_mark(struct record_adapter_base *rb)
+static enum zstrm_fmt zstrm_fmt_arg(val self, val format, enum zstrm_fmt dfl)
 {
-  delegate_base_mark(&rb->db);
-  gc_mark(rb->regex);
+  if (null_or_missing_p(format))
+    return dfl;
+  if (format == gzip_k)
+    return zfmt_gzip;
+  if (format == zlib_k)
+    return zfmt_zlib;
+  if (format == zstd_k)
+    return zfmt_zstd;
+  uw_throwf(error_s, lit("~a: unrecognized compression format ~s"),
+            self, format, nao);
 }
 
-static void record_adapter_mark_op(val stream)
+static val make_zstrm(val stream, struct strm_ops *ops, int output)
 {
-  struct record_adapter_base *rb = coerce(struct record_adapter_base *,
-                                         stream->co.handle);
-  record_adapter_base_mark(rb);
+  val zstream = make_delegate_stream(stream, sizeof (struct zstrm),
+                                     &ops->cobj_ops);
+  struct zstrm *zs = coerce(struct zstrm *, zstream->co.handle);
+
+  zs->is_output = output;
+  utf8_decoder_init(&zs->ud);
+  zs->cbuf = chk_malloc(ZSTRM_BUFSIZE);
+  zs->dbuf = chk_malloc(ZSTRM_BUFSIZE);
+  return zstream;
 }
 
-static val record_adapter_get_line(val stream)
+val make_decompress_stream(val stream_in, val format)
 {
-  struct record_adapter_base *rb = coerce(struct record_adapter_base *,
-                                         stream->co.handle);
-  return read_until_match(rb->regex, rb->db.target_stream, rb->include_match);
-}
+  val self = lit("make-decompress-stream");
+  val stream = default_arg(stream_in, std_input);
+  enum zstrm_fmt fmt = zstrm_fmt_arg(self, format, zfmt_auto);
+  val zstream = make_zstrm(stream, &decompress_ops, 0);
+  struct zstrm *zs = coerce(struct zstrm *, zstream->co.handle);
 
-static struct strm_ops record_adapter_ops =
-  strm_ops_init(cobj_ops_init(eq,
-                              stream_print_op,
-                              stream_destroy_op,
-                              record_adapter_mark_op,
-                              cobj_eq_hash_op),
-                wli("record-adapter"),
-                delegate_put_string, delegate_put_char, delegate_put_byte,
-                record_adapter_get_line, delegate_get_char, delegate_get_byte,
-                delegate_unget_char, delegate_unget_byte,
-                delegate_put_buf, delegate_fill_buf,
-                delegate_close, delegate_flush, delegate_seek,
-                delegate_truncate, delegate_get_prop, delegate_set_prop,
-                delegate_get_error, delegate_get_error_str,
-                delegate_clear_error, delegate_get_fd);
+  zs->at_end = 1;
 
-val record_adapter(val regex, val stream, val include_match)
+  if (fmt != zfmt_auto)
+    zstrm_open(zstream, zs, fmt, 0);
+
+  return zstream;
+}
+
+val make_compress_stream(val stream_in, val format, val level)
 {
-  val rec_adapter = make_delegate_stream(default_arg(stream, std_input),
-                                         sizeof (struct record_adapter_base),
-                                         &record_adapter_ops.cobj_ops);
-  struct record_adapter_base *rb = coerce(struct record_adapter_base *,
-                                          rec_adapter->co.handle);
+  val self = lit("make-compress-stream");
+  val stream = default_arg(stream_in, std_output);
+  enum zstrm_fmt fmt = zstrm_fmt_arg(self, format, zfmt_gzip);
+  val zstream = make_zstrm(stream, &compress_ops, 1);
+  struct zstrm *zs = coerce(struct zstrm *, zstream->co.handle);
+  int dfl_level = 0;
+
+#if HAVE_ZLIB
+  if (fmt != zfmt_zstd)
+    dfl_level = Z_DEFAULT_COMPRESSION;
+#endif
 
-  rb->regex = regex;
-  rb->include_match = default_null_arg(include_match);
-  return rec_adapter;
+  zstrm_open(zstream, zs, fmt, c_num(default_arg(level, num(dfl_level))));
+  return zstream;
 }
 
+#endif
+
 val streamp(val obj)
 {
   return typep(obj, stream_s);
@@ -2822,6 +5082,217 @@ val fill_buf(val buf, val pos_in, val stream_in)
   return ops->fill_buf(stream, buf, pos);
 }
 
+#if HAVE_SYS_STAT && (HAVE_SENDFILE || HAVE_COPY_FILE_RANGE)
+
+enum kcopy { kcopy_range, kcopy_sendfile, kcopy_none };
+
+static struct stdio_handle *kcopy_handle(val stream)
+{
+  struct strm_ops *ops = coerce(struct strm_ops *, stream->co.ops);
+
+  if (ops->get_char == stdio_get_char) {
+    struct stdio_handle *h = coerce(struct stdio_handle *, stream->co.handle);
+    if (h->f != 0 && !h->unget_c && h->ud.tail == h->ud.head &&
+        !h->is_nonblock)
+      return h;
+  }
+
+  return 0;
+}
+
+static ssize_t kcopy_chunk(enum kcopy method, int ifd, off_t *poff,
+                           int ofd, size_t size)
+{
+  switch (method) {
+#if HAVE_COPY_FILE_RANGE
+  case kcopy_range:
+    return copy_file_range(ifd, poff, ofd, 0, size, 0);
+#endif
+#if HAVE_SENDFILE
+  case kcopy_sendfile:
+    return sendfile(ofd, ifd, poff, size);
+#endif
+  default:
+    errno = ENOSYS;
+    return -1;
+  }
+}
+
+/*
+ * Copy from a regular file to any descriptor without passing the data
+ * through user space. The source is read at an explicit offset taken
+ * from its FILE, which is repositioned afterward; bytes already
+ * buffered by stdio are thus neither skipped nor duplicated.
+ * If the kernel refuses every method, the number of bytes transferred
+ * so far is returned with *pdone clear, and the caller carries on
+ * with buffered copying.
+ */
+static ucnum copy_stream_kernel(val self, val from, val to,
+                                ucnum limit, int limited, int *pdone)
+{
+  struct stdio_handle *hf = kcopy_handle(from);
+  struct stdio_handle *ht = kcopy_handle(to);
+  struct stat st;
+  enum kcopy method;
+  ucnum total = 0;
+  int ifd, ofd, oreg, err = 0;
+  off_t off;
+
+  *pdone = 0;
+
+  if (!hf || !ht)
+    return 0;
+
+  ifd = fileno(hf->f);
+  ofd = fileno(ht->f);
+
+  if (fstat(ifd, &st) < 0 || !S_ISREG(st.st_mode))
+    return 0;
+
+  stdio_switch(hf, stdio_read);
+#if HAVE_FSEEKO
+  off = ftello(hf->f);
+#else
+  off = ftell(hf->f);
+#endif
+  if (off < 0)
+    return 0;
+
+  oreg = (fstat(ofd, &st) == 0 && S_ISREG(st.st_mode));
+  method = oreg ? kcopy_range : kcopy_sendfile;
+
+  stdio_switch(ht, stdio_write);
+  if (se_fflush(ht->f) != 0)
+    stdio_maybe_error(to, lit("writing"));
+
+  while (method != kcopy_none) {
+    size_t size = 0x40000000;
+    ssize_t nwrit;
+
+    if (limited) {
+      if (limit == 0) {
+        *pdone = 1;
+        break;
+      }
+      if (limit < size)
+        size = limit;
+    }
+
+    sig_save_enable;
+    nwrit = kcopy_chunk(method, ifd, &off, ofd, size);
+    sig_restore_enable;
+
+    if (nwrit > 0) {
+      total += nwrit;
+      limit -= nwrit;
+    } else if (nwrit == 0) {
+      *pdone = 1;
+      break;
+    } else if (errno == EINTR) {
+      continue;
+    } else if (errno == EINVAL || errno == ENOSYS || errno == EXDEV ||
+               errno == EBADF
+#ifdef EOPNOTSUPP
+               || errno == EOPNOTSUPP
+#endif
+               )
+    {
+      method = convert(enum kcopy, method + 1);
+    } else {
+      err = errno;
+      break;
+    }
+  }
+
+#if HAVE_FSEEKO
+  fseeko(hf->f, off, SEEK_SET);
+  if (oreg)
+    fseeko(ht->f, 0, SEEK_CUR);
+#else
+  fseek(hf->f, off, SEEK_SET);
+  if (oreg)
+    fseek(ht->f, 0, SEEK_CUR);
+#endif
+
+  if (err != 0) {
+    ht->err = num(err);
+    uw_throwf(file_error_s, lit("~a: error copying ~a to ~a: ~d/~s"),
+              self, from, to, num(err), errno_to_string(num(err)), nao);
+  }
+
+  return total;
+}
+
+#endif
+
+static ucnum copy_stream_buffered(val self, val from, val to,
+                                  ucnum limit, int limited)
+{
+  struct strm_ops *fops = coerce(struct strm_ops *, from->co.ops);
+  struct strm_ops *tops = coerce(struct strm_ops *, to->co.ops);
+  const cnum blksize = 65536;
+  val buf = make_buf(num_fast(blksize), nil, nil);
+  cnum len = blksize;
+  ucnum total = 0;
+
+  for (;;) {
+    cnum want = blksize, got, pos;
+
+    if (limited) {
+      if (limit == 0)
+        break;
+      if (limit < convert(ucnum, want))
+        want = limit;
+    }
+
+    if (want != len)
+      buf_set_length(buf, num_fast(len = want), nil);
+
+    if ((got = c_num(fops->fill_buf(from, buf, 0))) <= 0)
+      break;
+
+    if (got != len)
+      buf_set_length(buf, num_fast(len = got), nil);
+
+    for (pos = 0; pos < got; ) {
+      cnum npos = c_num(tops->put_buf(to, buf, pos));
+      if (npos <= pos)
+        uw_throwf(file_error_s, lit("~a: unable to write to ~a"),
+                  self, to, nao);
+      pos = npos;
+    }
+
+    total += got;
+    limit -= got;
+  }
+
+  return total;
+}
+
+val copy_stream(val from_stream, val to_stream, val limit_in)
+{
+  val self = lit("copy-stream");
+  int limited = !null_or_missing_p(limit_in);
+  ucnum limit = if3(limited, c_unum(limit_in), 0), total = 0;
+
+  (void) cobj_ops(from_stream, stream_s);
+  (void) cobj_ops(to_stream, stream_s);
+
+#if HAVE_SYS_STAT && (HAVE_SENDFILE || HAVE_COPY_FILE_RANGE)
+  {
+    int done;
+    total = copy_stream_kernel(self, from_stream, to_stream,
+                               limit, limited, &done);
+    if (done)
+      return unum(total);
+    limit -= total;
+  }
+#endif
+
+  total += copy_stream_buffered(self, from_stream, to_stream, limit, limited);
+  return unum(total);
+}
+
 struct fmt {
   size_t minsize;
   const char *dec;
@@ -3481,6 +5952,11 @@ val put_string(val string, val stream_in)
     }
 
     for (; *p; p++) {
+      if (*p >= 0x20 && *p < 0x7F) {
+        col++;
+        continue;
+      }
+
       switch (*p) {
       case '\n':
         col = 0;
@@ -3696,24 +6172,37 @@ struct strm_ctx *get_ctx(val stream)
 val get_string(val stream_in, val nchars, val close_after_p)
 {
   val stream = default_arg(stream_in, std_input);
-  val strstream = make_string_output_stream();
+  struct strm_ops *ops = coerce(struct strm_ops *, cobj_ops(stream, stream_s));
+  val out;
+
   nchars = default_null_arg(nchars);
-  val ch;
 
-  if (nchars) {
-    for (; gt(nchars, zero) && (ch = get_char(stream));
-         nchars = minus(nchars, one))
-      put_char(ch, strstream);
+  if (!nchars && ops->get_char == stdio_get_char) {
+    out = stdio_get_string(stream);
+#if HAVE_READ_AHEAD
+  } else if (!nchars && ops->get_char == rdahead_get_char) {
+    out = rdahead_get_string(stream);
+#endif
   } else {
-    while ((ch = get_char(stream)))
-      put_char(ch, strstream);
+    val strstream = make_string_output_stream();
+    val ch;
+
+    if (nchars) {
+      for (; gt(nchars, zero) && (ch = get_char(stream));
+           nchars = minus(nchars, one))
+        put_char(ch, strstream);
+    } else {
+      while ((ch = get_char(stream)))
+        put_char(ch, strstream);
+    }
+    out = get_string_from_stream(strstream);
   }
 
   if ((missingp(close_after_p) && (!opt_compat || opt_compat > 102)) ||
       default_arg_strict(close_after_p, t))
     close_stream(stream, t);
 
-  return get_string_from_stream(strstream);
+  return out;
 }
 
 static DIR *w_opendir(const wchar_t *wname)
@@ -3882,6 +6371,56 @@ val open_command(val path, val mode_str)
 }
 
 #if HAVE_FORK_STUFF
+
+#if HAVE_POSIX_SPAWN
+/*
+ * Launch a process without fork, which has to duplicate the page
+ * tables of the whole image; the C library implements posix_spawn
+ * with vfork or an equivalent clone. If fd is not null, it is a pipe,
+ * and the child's standard output (input is true) or standard input
+ * is redirected to the appropriate end, just as in the fork code
+ * below. Returns -1 if the process could not be launched for any
+ * reason, including a failed exec; the caller then falls back on fork,
+ * so that failures are reported exactly as before. Binding
+ * sys:*posix-spawn* to nil selects the fork path directly.
+ */
+static pid_t spawn_process(char **argv, int *fd, int input)
+{
+  extern char **environ;
+  posix_spawn_file_actions_t fa;
+  pid_t pid;
+  int res;
+
+  if (!cdr(lookup_var(nil, posix_spawn_s)))
+    return -1;
+
+  if (posix_spawn_file_actions_init(&fa) != 0)
+    return -1;
+
+  if (fd == 0) {
+    res = 0;
+  } else if (input) {
+    res = posix_spawn_file_actions_adddup2(&fa, fd[1], STDOUT_FILENO);
+    if (res == 0 && fd[1] != STDOUT_FILENO)
+      res = posix_spawn_file_actions_addclose(&fa, fd[1]);
+    if (res == 0)
+      res = posix_spawn_file_actions_addclose(&fa, fd[0]);
+  } else {
+    res = posix_spawn_file_actions_adddup2(&fa, fd[0], STDIN_FILENO);
+    if (res == 0 && fd[0] != STDIN_FILENO)
+      res = posix_spawn_file_actions_addclose(&fa, fd[0]);
+    if (res == 0)
+      res = posix_spawn_file_actions_addclose(&fa, fd[1]);
+  }
+
+  if (res == 0)
+    res = posix_spawnp(&pid, argv[0], &fa, 0, argv, environ);
+
+  posix_spawn_file_actions_destroy(&fa);
+  return if3(res == 0, pid, -1);
+}
+#endif
+
 val open_process(val name, val mode_str, val args)
 {
   val self = lit("open-process");
@@ -3922,7 +6461,10 @@ val open_process(val name, val mode_str, val args)
   }
   argv[i] = 0;
 
-  pid = fork();
+#if HAVE_POSIX_SPAWN
+  if ((pid = spawn_process(argv, fd, input)) == -1)
+#endif
+    pid = fork();
 
   if (pid == -1) {
     for (i = 0; i < nargs; i++)
@@ -4118,7 +6660,10 @@ static val run(val name, val args)
 
   fds_swizzle(&sfds, FDS_IN | FDS_OUT | FDS_ERR);
 
-  pid = fork();
+#if HAVE_POSIX_SPAWN
+  if ((pid = spawn_process(argv, 0, 0)) == -1)
+#endif
+    pid = fork();
 
   if (pid == -1) {
     for (i = 0; i < nargs; i++)
@@ -4436,6 +6981,12 @@ void stream_init(void)
   addr_k = intern(lit("addr"), keyword_package);
   fd_k = intern(lit("fd"), keyword_package);
   byte_oriented_k = intern(lit("byte-oriented"), keyword_package);
+  nonblock_k = intern(lit("nonblock"), keyword_package);
+  pending_k = intern(lit("pending"), keyword_package);
+  gzip_k = intern(lit("gzip"), keyword_package);
+  zlib_k = intern(lit("zlib"), keyword_package);
+  zstd_k = intern(lit("zstd"), keyword_package);
+  read_ahead_k = intern(lit("read-ahead"), keyword_package);
   format_s = intern(lit("format"), user_package);
   stdio_stream_s = intern(lit("stdio-stream"), user_package);
 #if HAVE_SOCKETS
@@ -4501,6 +7052,7 @@ void stream_init(void)
   reg_fun(intern(lit("unget-byte"), user_package), func_n2o(unget_byte, 1));
   reg_fun(intern(lit("put-buf"), user_package), func_n3o(put_buf, 1));
   reg_fun(intern(lit("fill-buf"), user_package), func_n3o(fill_buf, 1));
+  reg_fun(intern(lit("copy-stream"), user_package), func_n3o(copy_stream, 2));
   reg_fun(intern(lit("flush-stream"), user_package), func_n1o(flush_stream, 0));
   reg_fun(intern(lit("seek-stream"), user_package), func_n3(seek_stream));
   reg_fun(intern(lit("truncate-stream"), user_package), func_n2(truncate_stream));
@@ -4520,6 +7072,18 @@ void stream_init(void)
   reg_fun(intern(lit("catenated-stream-p"), user_package), func_n1(catenated_stream_p));
   reg_fun(intern(lit("catenated-stream-push"), user_package), func_n2(catenated_stream_push));
   reg_fun(intern(lit("record-adapter"), user_package), func_n3o(record_adapter, 1));
+#if HAVE_ZLIB || HAVE_ZSTD
+  reg_fun(intern(lit("make-decompress-stream"), user_package), func_n2o(make_decompress_stream, 0));
+  reg_fun(intern(lit("make-compress-stream"), user_package), func_n3o(make_compress_stream, 0));
+  reg_varl(intern(lit("compress-formats"), user_package),
+#if HAVE_ZLIB && HAVE_ZSTD
+           list(gzip_k, zlib_k, zstd_k, nao));
+#elif HAVE_ZLIB
+           list(gzip_k, zlib_k, nao));
+#else
+           list(zstd_k, nao));
+#endif
+#endif
   reg_fun(intern(lit("open-directory"), user_package), func_n1(open_directory));
   reg_fun(intern(lit("open-file"), user_package), func_n2o(open_file, 1));
   reg_fun(intern(lit("open-fileno"), user_package), func_n2o(open_fileno, 1));
@@ -4529,6 +7093,9 @@ void stream_init(void)
   reg_fun(intern(lit("open-process"), user_package), func_n3o(open_process, 2));
   reg_fun(intern(lit("sh"), user_package), func_n1(sh));
   reg_fun(intern(lit("run"), user_package), func_n2o(run, 1));
+#if HAVE_POSIX_SPAWN
+  reg_var(posix_spawn_s = intern(lit("*posix-spawn*"), system_package), t);
+#endif
   reg_fun(intern(lit("remove-path"), user_package), func_n2o(remove_path, 1));
   reg_fun(intern(lit("rename-path"), user_package), func_n2(rename_path));
   reg_fun(intern(lit("open-files"), user_package), func_n2o(open_files, 1));
@@ -4565,6 +7132,13 @@ void stream_init(void)
   fill_stream_ops(&strlist_out_ops);
   fill_stream_ops(&dir_ops);
   fill_stream_ops(&cat_stream_ops);
+#if HAVE_ZLIB || HAVE_ZSTD
+  fill_stream_ops(&decompress_ops);
+  fill_stream_ops(&compress_ops);
+#endif
+#if HAVE_READ_AHEAD
+  fill_stream_ops(&rdahead_ops);
+#endif
 
 #if HAVE_SOCKETS
   stdio_sock_ops = stdio_ops;
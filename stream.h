@@ -118,7 +118,9 @@ struct stdio_mode {
 loc lookup_var_l(val env, val sym);
 
 extern val from_start_k, from_current_k, from_end_k;
-extern val real_time_k, name_k, addr_k, fd_k, byte_oriented_k;
+extern val real_time_k, name_k, addr_k, fd_k, byte_oriented_k, nonblock_k;
+extern val read_ahead_k, pending_k;
+extern val gzip_k, zlib_k, zstd_k;
 extern val format_s;
 
 extern val stdio_stream_s;
@@ -167,6 +169,10 @@ val make_strlist_output_stream(void);
 val get_list_from_stream(val);
 val make_dir_stream(DIR *);
 val record_adapter(val regex, val stream, val include_match);
+#if HAVE_ZLIB || HAVE_ZSTD
+val make_decompress_stream(val stream, val format);
+val make_compress_stream(val stream, val format, val level);
+#endif
 val streamp(val obj);
 val real_time_stream_p(val obj);
 val stream_set_prop(val stream, val ind, val prop);
@@ -180,8 +186,11 @@ val get_char(val);
 val get_byte(val);
 val unget_char(val ch, val stream);
 val unget_byte(val byte, val stream);
+cnum get_chars_avail(val stream, wchar_t *buf, cnum size);
+void unget_chars(val stream, const wchar_t *str, cnum n);
 val put_buf(val buf, val pos, val stream);
 val fill_buf(val buf, val pos, val stream);
+val copy_stream(val from_stream, val to_stream, val limit);
 val vformat(val stream, val string, va_list);
 val vformat_to_string(val string, va_list);
 val format(val stream, val string, ...);
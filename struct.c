@@ -497,6 +497,14 @@ static void call_postinitfun_chain(struct struct_type *st, val strct)
   }
 }
 
+static int struct_has_initfuns(struct struct_type *st)
+{
+  for (; st; st = if3(st->super, st->super_handle, 0))
+    if (st->initfun || st->postinitfun)
+      return 1;
+  return 0;
+}
+
 val make_struct(val type, val plist, struct args *args)
 {
   val self = lit("make-struct");
@@ -525,6 +533,9 @@ val make_struct(val type, val plist, struct args *args)
 
   bug_unless (type == st->self);
 
+  if (!plist && !args_more(args, 0) && !struct_has_initfuns(st))
+    return sinst;
+
   uw_simple_catch_begin;
 
   call_initfun_chain(st, sinst);
@@ -982,6 +993,55 @@ val slotset(val strct, val sym, val newval)
   no_such_slot(self, si->type->self, sym);
 }
 
+/*
+ * Instance slot indices let callers that repeatedly access the same
+ * slots of a known struct type, such as the FFI, skip the lookup.
+ * The index is valid only for instances whose type is exactly stype;
+ * for anything else, access falls back on the named slot.
+ */
+cnum slot_index(val stype, val sym)
+{
+  struct struct_type *st = stype_handle(&stype, lit("slot-index"));
+
+  if (sym && symbolp(sym) && memq(sym, st->slots)) {
+    val key = cons(sym, num_fast(st->id));
+    val sl = gethash(slot_hash, key);
+    cnum slnum = coerce(cnum, sl) >> TAG_SHIFT;
+
+    if (sl && slnum < STATIC_SLOT_BASE)
+      return slnum;
+  }
+
+  return -1;
+}
+
+val slot_by_index(val strct, val stype, cnum idx, val sym)
+{
+  if (idx >= 0 && cobjp(strct) && strct->co.ops == &struct_inst_ops) {
+    struct struct_inst *si = coerce(struct struct_inst *, strct->co.handle);
+    if (si->type->self == stype) {
+      check_init_lazy_struct(strct, si);
+      return si->slot[idx];
+    }
+  }
+
+  return slot(strct, sym);
+}
+
+val slotset_by_index(val strct, val stype, cnum idx, val sym, val newval)
+{
+  if (idx >= 0 && cobjp(strct) && strct->co.ops == &struct_inst_ops) {
+    struct struct_inst *si = coerce(struct struct_inst *, strct->co.handle);
+    if (si->type->self == stype) {
+      check_init_lazy_struct(strct, si);
+      si->dirty = 1;
+      return set(mkloc(si->slot[idx], strct), newval);
+    }
+  }
+
+  return slotset(strct, sym, newval);
+}
+
 val static_slot(val stype, val sym)
 {
   val self = lit("static-slot");
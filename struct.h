@@ -51,6 +51,9 @@ val find_struct_type(val sym);
 val slot(val strct, val sym);
 val maybe_slot(val strct, val sym);
 val slotset(val strct, val sym, val newval);
+cnum slot_index(val stype, val sym);
+val slot_by_index(val strct, val stype, cnum idx, val sym);
+val slotset_by_index(val strct, val stype, cnum idx, val sym, val newval);
 val static_slot(val stype, val sym);
 val static_slot_set(val stype, val sym, val newval);
 val static_slot_ensure(val stype, val sym, val newval, val no_error_p);
@@ -56,6 +56,9 @@
 #if HAVE_POLL
 #include <poll.h>
 #endif
+#if HAVE_EPOLL
+#include <sys/epoll.h>
+#endif
 #if HAVE_PWUID
 #include <pwd.h>
 #endif
@@ -563,6 +566,14 @@ static val dup_wrap(val old, val neu)
   return num(dup2(c_num(old), c_num(neu)));
 }
 
+static val close_wrap(val fd)
+{
+  if (close(c_num(fd)) < 0)
+    uw_throwf(file_error_s, lit("closefd ~a: ~d/~s"),
+              fd, num(errno), string_utf8(strerror(errno)), nao);
+  return t;
+}
+
 val exec_wrap(val file, val args_opt)
 {
   val self = lit("execvp");
@@ -857,6 +868,98 @@ static val poll_wrap(val poll_list, val timeout_in)
 
 #endif
 
+#if HAVE_EPOLL
+
+static int epoll_fd_of(val obj, val self)
+{
+  switch (type(obj)) {
+  case NUM:
+    return c_num(obj);
+  case COBJ:
+    if (subtypep(obj->co.cls, stream_s)) {
+      val fdval = stream_get_prop(obj, fd_k);
+      if (!fdval)
+        uw_throwf(file_error_s,
+                  lit("~a: stream ~s doesn't have a file descriptor"),
+                  self, obj, nao);
+      return c_num(fdval);
+    }
+    /* fallthrough */
+  default:
+    uw_throwf(file_error_s,
+              lit("~a: ~s isn't a stream or file descriptor"),
+              self, obj, nao);
+  }
+}
+
+static val epoll_create_wrap(void)
+{
+  int fd = epoll_create1(EPOLL_CLOEXEC);
+
+  if (fd < 0)
+    uw_throwf(file_error_s, lit("epoll-create failed: ~d/~s"),
+              num(errno), string_utf8(strerror(errno)), nao);
+
+  return num(fd);
+}
+
+static val epoll_ctl_wrap(val epfd, val op, val obj, val events)
+{
+  val self = lit("epoll-ctl");
+  int fd = epoll_fd_of(obj, self);
+  struct epoll_event ev;
+
+  memset(&ev, 0, sizeof ev);
+  ev.events = c_unum(default_arg(events, zero));
+  ev.data.fd = fd;
+
+  if (epoll_ctl(c_num(epfd), c_num(op), fd, &ev) < 0)
+    uw_throwf(file_error_s, lit("~a ~s failed: ~d/~s"),
+              self, obj, num(errno), string_utf8(strerror(errno)), nao);
+
+  return t;
+}
+
+static val epoll_wait_wrap(val epfd, val maxevents_in, val timeout_in)
+{
+  val self = lit("epoll-wait");
+  int maxevents = c_num(default_arg(maxevents_in, num_fast(64)));
+  val timeout = default_arg(timeout_in, negone);
+  struct epoll_event *evs;
+  int i, res;
+
+  if (maxevents <= 0)
+    uw_throwf(error_s, lit("~a: maxevents must be positive, not ~s"),
+              self, maxevents_in, nao);
+
+  evs = coerce(struct epoll_event *, chk_xalloc(maxevents, sizeof *evs, self));
+
+  sig_save_enable;
+
+  res = epoll_wait(c_num(epfd), evs, maxevents, c_num(timeout));
+
+  sig_restore_enable;
+
+  if (res < 0) {
+    free(evs);
+    uw_throwf(file_error_s, lit("~a failed: ~d/~s"),
+              self, num(errno), string_utf8(strerror(errno)), nao);
+  }
+
+  {
+    list_collect_decl (out, ptail);
+
+    for (i = 0; i < res; i++)
+      ptail = list_collect(ptail, cons(num(evs[i].data.fd),
+                                       unum(evs[i].events)));
+
+    free(evs);
+    return out;
+  }
+}
+
+#endif
+
 #if HAVE_GETEUID
 
 static val getuid_wrap(void)
@@ -1816,6 +1919,21 @@ void sysif_init(void)
   reg_varl(intern(lit("poll-wrband"), user_package), num_fast(POLLWRBAND));
 #endif
 #endif
+#if HAVE_EPOLL
+  reg_varl(intern(lit("epoll-in"), user_package), num_fast(EPOLLIN));
+  reg_varl(intern(lit("epoll-out"), user_package), num_fast(EPOLLOUT));
+  reg_varl(intern(lit("epoll-err"), user_package), num_fast(EPOLLERR));
+  reg_varl(intern(lit("epoll-hup"), user_package), num_fast(EPOLLHUP));
+  reg_varl(intern(lit("epoll-pri"), user_package), num_fast(EPOLLPRI));
+#ifdef EPOLLRDHUP
+  reg_varl(intern(lit("epoll-rdhup"), user_package), num_fast(EPOLLRDHUP));
+#endif
+  reg_varl(intern(lit("epoll-et"), user_package), unum(EPOLLET));
+  reg_varl(intern(lit("epoll-oneshot"), user_package), num_fast(EPOLLONESHOT));
+  reg_varl(intern(lit("epoll-ctl-add"), user_package), num_fast(EPOLL_CTL_ADD));
+  reg_varl(intern(lit("epoll-ctl-mod"), user_package), num_fast(EPOLL_CTL_MOD));
+  reg_varl(intern(lit("epoll-ctl-del"), user_package), num_fast(EPOLL_CTL_DEL));
+#endif
 
 #if HAVE_FORK_STUFF
   reg_fun(intern(lit("fork"), user_package), func_n0(fork_wrap));
@@ -1844,6 +1962,7 @@ void sysif_init(void)
   reg_varl(intern(lit("w-continued"), user_package), num_fast(WCONTINUED));
 #endif
   reg_fun(intern(lit("dupfd"), user_package), func_n2o(dup_wrap, 1));
+  reg_fun(intern(lit("closefd"), user_package), func_n1(close_wrap));
 #endif
 #if HAVE_PIPE
   reg_fun(intern(lit("pipe"), user_package), func_n0(pipe_wrap));
@@ -1899,6 +2018,12 @@ void sysif_init(void)
   reg_fun(intern(lit("poll"), user_package), func_n2o(poll_wrap, 1));
 #endif
 
+#if HAVE_EPOLL
+  reg_fun(intern(lit("epoll-create"), user_package), func_n0(epoll_create_wrap));
+  reg_fun(intern(lit("epoll-ctl"), user_package), func_n4o(epoll_ctl_wrap, 3));
+  reg_fun(intern(lit("epoll-wait"), user_package), func_n3o(epoll_wait_wrap, 1));
+#endif
+
 #if HAVE_SYS_STAT
   reg_fun(intern(lit("umask"), user_package), func_n1o(umask_wrap, 0));
 #endif
@@ -32,10 +32,14 @@
 #include <stdarg.h>
 #include <wchar.h>
 #include <signal.h>
+#include <errno.h>
 #include "config.h"
 #if HAVE_UNISTD_H
 #include <unistd.h>
 #endif
+#if HAVE_SYS_WAIT
+#include <sys/wait.h>
+#endif
 #if HAVE_WINDOWS_H
 #include <windows.h>
 #undef TEXT
@@ -67,6 +71,9 @@ int opt_noninteractive;
 int opt_compat;
 int opt_dbg_expansion;
 val stdlib_path;
+#if HAVE_FORK_STUFF
+static int opt_jobs;
+#endif
 
 /*
  * Can implement an emergency allocator here from a fixed storage
@@ -158,6 +165,11 @@ static void help(void)
 "--compat=N             Synonym for -C N\n"
 "--gc-delta=N           Invoke garbage collection when malloc activity\n"
 "                       increments by N megabytes since last collection.\n"
+#if HAVE_FORK_STUFF
+"--jobs=N               Match the query against each data-file separately,\n"
+"                       in up to N parallel processes. Output appears\n"
+"                       in data-file order.\n"
+#endif
 "--args...              Allows multiple arguments to be encoded as a single\n"
 "                       argument. This is useful in hash-bang scripting.\n"
 "                       Peculiar syntax. See manual.\n"
@@ -438,6 +450,118 @@ static int gc_delta(val optval)
   return 1;
 }
 
+#if HAVE_FORK_STUFF
+enum { JOBS_MAX = 1024 };
+
+static int jobs(val optval)
+{
+  cnum n = c_num(optval);
+
+  if (n <= 0 || n > JOBS_MAX) {
+    format(std_error, lit("~a: option --jobs needs an argument "
+                          "from 1 to ~a, not ~a\n"),
+           prog_string, num_fast(JOBS_MAX), optval, nao);
+    return 0;
+  }
+
+  opt_jobs = n;
+  return 1;
+}
+
+struct job {
+  pid_t pid;
+  FILE *out;
+};
+
+static void job_start(struct job *job, val spec, val file, val bindings)
+{
+  fflush(stdout);
+  fflush(stderr);
+
+  if ((job->out = tmpfile()) == 0) {
+    job->pid = -1;
+    return;
+  }
+
+  if ((job->pid = fork()) == 0) {
+    val result;
+
+    dup2(fileno(job->out), STDOUT_FILENO);
+    result = extract(spec, cons(file, nil), bindings);
+    flush_stream(std_output);
+    fflush(stdout);
+    _exit(cdr(result) ? 0 : EXIT_FAILURE);
+  }
+
+  if (job->pid == -1) {
+    fclose(job->out);
+    job->out = 0;
+  }
+}
+
+static int job_finish(struct job *job)
+{
+  char buf[BUFSIZ];
+  size_t nread;
+  int status;
+
+  while (waitpid(job->pid, &status, 0) == -1 && errno == EINTR)
+    ;
+
+  rewind(job->out);
+
+  while ((nread = fread(buf, 1, sizeof buf, job->out)) > 0)
+    fwrite(buf, 1, nread, stdout);
+
+  fclose(job->out);
+
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/*
+ * Match the spec separately against each of the files, in up to opt_jobs
+ * child processes at a time. The output of each child is captured in a
+ * temporary file and copied out in the order of the files. If a child cannot
+ * be created, no more are started: once the children already running have
+ * been collected, that file and the ones after it are processed in this
+ * process, so that no child inherits state from matching done here.
+ */
+static int extract_jobs(val spec, val files, val bindings)
+{
+  val fvec = vec_list(files);
+  cnum nfiles = c_num(length(fvec)), i, next = 0;
+  struct job *job = coerce(struct job *,
+                           chk_calloc(nfiles, sizeof *job));
+  int ok = 1, serial = 0;
+
+  flush_stream(std_output);
+
+  for (i = 0; i < nfiles; i++) {
+    val file = vecref(fvec, num(i));
+
+    for (; !serial && next < nfiles && next < i + opt_jobs; next++) {
+      job_start(&job[next], spec, vecref(fvec, num(next)), bindings);
+      if (job[next].pid == -1)
+        serial = 1;
+    }
+
+    if (i < next && job[i].pid != -1) {
+      if (!job_finish(&job[i]))
+        ok = 0;
+    } else {
+      val result = extract(spec, cons(file, nil), bindings);
+      if (!cdr(result))
+        ok = 0;
+      flush_stream(std_output);
+    }
+  }
+
+  fflush(stdout);
+  free(job);
+  return ok;
+}
+#endif
+
 static void free_all(void)
 {
   static int called;
@@ -624,6 +748,14 @@ int txr_main(int argc, char **argv)
         continue;
       }
 
+#if HAVE_FORK_STUFF
+      if (equal(opt, lit("jobs"))) {
+        if (!do_fixnum_opt(jobs, opt, org))
+          return EXIT_FAILURE;
+        continue;
+      }
+#endif
+
       /* Long opts with no arguments */
       if (org) {
         drop_privilege();
@@ -987,7 +1119,8 @@ int txr_main(int argc, char **argv)
   {
     int gc = gc_state(0);
     parser_t parser;
-    parse_once(parse_stream, spec_file_str, &parser);
+    parse_once(parse_stream, spec_file_str, &parser,
+               tnil(parse_stream != std_input));
     gc_state(gc);
 
     close_stream(parse_stream, nil);
@@ -1008,6 +1141,11 @@ int txr_main(int argc, char **argv)
 
     reg_var(intern(lit("*self-path*"), user_package), spec_file_str);
 
+#if HAVE_FORK_STUFF
+    if (opt_jobs && !enter_repl && arg_list)
+      return extract_jobs(spec, arg_list, bindings) ? 0 : EXIT_FAILURE;
+#endif
+
     {
       val result = extract(spec, arg_list, bindings);
       cons_bind (new_bindings, success, result);
@@ -1027,7 +1165,8 @@ int txr_main(int argc, char **argv)
   }
 
   {
-    val result = read_eval_stream(parse_stream, std_error);
+    val result = read_eval_stream(parse_stream, std_error,
+                                  tnil(parse_stream != std_input));
 
     close_stream(parse_stream, nil);
 
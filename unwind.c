@@ -37,6 +37,13 @@
 #if HAVE_VALGRIND
 #include <valgrind/memcheck.h>
 #endif
+#if HAVE_UCONTEXT
+#include <ucontext.h>
+#if HAVE_MMAP
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#endif
 #include "lib.h"
 #include "gc.h"
 #include "args.h"
@@ -57,6 +64,10 @@ static uw_frame_t unhandled_ex;
 
 static val unhandled_hook_s, types_s, jump_s, sys_cont_s, sys_cont_poison_s;
 static val sys_cont_free_s, sys_capture_cont_s;
+#if HAVE_UCONTEXT
+static val sys_cor_s, sys_cor_yield_s;
+#endif
+static val obtain_stack_size_s, stack_overflow_s;
 
 static val frame_type, catch_frame_type, handle_frame_type;
 
@@ -67,6 +78,28 @@ static val deferred_warnings, tentative_defs;
 val uw_block_return(val tag, val result);
 #endif
 
+#if HAVE_UCONTEXT
+
+/* Collector state saved by cor_leave, restored by cor_land. */
+static int cor_gc_saved = -1;
+
+/* Called just before an unwinding jumps to its next frame. If it is
+   leaving an aborted coroutine, that frame is on the resumer's stack,
+   which is what the collector regards as the stack again. */
+static void cor_land(void)
+{
+  if (cor_gc_saved >= 0) {
+    gc_state(cor_gc_saved);
+    cor_gc_saved = -1;
+  }
+}
+
+#else
+
+#define cor_land() ((void) 0)
+
+#endif
+
 static void uw_unwind_to_exit_point(void)
 {
   assert (uw_exit_point);
@@ -90,6 +123,7 @@ static void uw_unwind_to_exit_point(void)
       uw_stack->ca.sym = nil;
       uw_stack->ca.args = nil;
       uw_stack->ca.cont = uw_exit_point;
+      cor_land();
       /* 1 means unwind only. */
       extended_longjmp(uw_stack->ca.jb, 1);
       abort();
@@ -135,6 +169,8 @@ static void uw_unwind_to_exit_point(void)
   if (!uw_stack)
     abort();
 
+  cor_land();
+
   switch (uw_stack->uw.type) {
   case UW_BLOCK:
     extended_longjmp(uw_stack->bl.jb, 1);
@@ -821,6 +857,400 @@ void uw_continue(uw_frame_t *cont)
   uw_unwind_to_exit_point();
 }
 
+#if HAVE_UCONTEXT
+
+/*
+ * One-shot coroutines for obtain/yield. Each coroutine runs on a
+ * separately allocated stack, so suspending and resuming it is a
+ * register switch, rather than a copy of the stack segment as
+ * done by capture_cont and revive_cont.
+ */
+
+#define COR_STACK_SIZE (256 * 1024 * sizeof (val))
+#define COR_STACK_MIN (4096 * sizeof (val))
+#define COR_GUARD_SIZE (8192 * sizeof (val))
+
+enum cor_state {
+  COR_FRESH, COR_RUNNING, COR_SUSPENDED, COR_DONE, COR_ABORTED
+};
+
+struct coroutine {
+  enum cor_state state;
+  val fun;
+  val result;
+  val resumer;
+  mem_t *stack;
+  size_t stack_size;
+  uw_frame_t *base, *exit;
+  /* Coroutine context, while suspended. */
+  struct jmp jb;
+  val *top;
+  uw_frame_t *uw_top, *env_top;
+  val dyn_env;
+  /* Resumer context, while running. */
+  struct jmp res_jb;
+  struct gc_stack res_stack;
+  uw_frame_t *res_uw, *res_env;
+  val res_dyn_env;
+#if HAVE_MMAP
+  mem_t *map;
+  size_t map_size;
+#endif
+#if HAVE_VALGRIND
+  unsigned vg_id;
+#endif
+  ucontext_t uc;
+};
+
+static val cor_current;
+
+static struct coroutine *cor_struct(val cor)
+{
+  return coerce(struct coroutine *, cobj_handle(cor, sys_cor_s));
+}
+
+static int cor_on_stack(struct coroutine *co, uw_frame_t *fr)
+{
+  mem_t *ptr = coerce(mem_t *, fr);
+  return co->stack && ptr >= co->stack && ptr < co->stack + co->stack_size;
+}
+
+/* Where mmap is available, the stack is preceded by an inaccessible
+   guard region, so that running off its end faults rather than
+   overwriting other memory. The fault is turned into a stack-overflow
+   exception by the SIGSEGV handler; see uw_stack_guard_fault. */
+static void cor_alloc_stack(struct coroutine *co, val self)
+{
+#if HAVE_MMAP
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t guard = (COR_GUARD_SIZE + page - 1) / page * page;
+  size_t size;
+  void *map;
+
+  sig_stack_guard();
+  co->stack_size = (co->stack_size + page - 1) / page * page;
+  size = co->stack_size + guard;
+  map = mmap(0, size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+  if (map == MAP_FAILED)
+    uw_throwf(error_s, lit("~a: unable to allocate coroutine stack"),
+              self, nao);
+
+  if (mprotect(map, guard, PROT_NONE) != 0) {
+    munmap(map, size);
+    uw_throwf(error_s, lit("~a: unable to allocate coroutine stack"),
+              self, nao);
+  }
+
+  co->map = coerce(mem_t *, map);
+  co->map_size = size;
+  co->stack = co->map + guard;
+#else
+  co->stack = coerce(mem_t *, chk_malloc(co->stack_size));
+#endif
+#if HAVE_VALGRIND
+  co->vg_id = VALGRIND_STACK_REGISTER(co->stack,
+                                     co->stack + co->stack_size);
+#endif
+}
+
+static void cor_free_stack(struct coroutine *co)
+{
+  if (co->stack) {
+#if HAVE_VALGRIND
+    VALGRIND_STACK_DEREGISTER(co->vg_id);
+#endif
+#if HAVE_MMAP
+    munmap(co->map, co->map_size);
+    co->map = 0;
+#else
+    free(co->stack);
+#endif
+    co->stack = 0;
+  }
+}
+
+#if HAVE_MMAP
+
+/* Called from the SIGSEGV handler: does addr fall in the guard region
+   of the running coroutine? */
+int uw_stack_guard_fault(mem_t *addr)
+{
+  if (cor_current) {
+    struct coroutine *co = coerce(struct coroutine *,
+                                  cor_current->co.handle);
+    return co->map && addr >= co->map && addr < co->stack;
+  }
+
+  return 0;
+}
+
+/* Called from the SIGSEGV handler, on the alternate signal stack. */
+void uw_stack_overflow(void)
+{
+  struct coroutine *co = coerce(struct coroutine *, cor_current->co.handle);
+  uw_throwf(stack_overflow_s, lit("obtain: generator overflowed its "
+                                  "stack of ~s bytes"),
+            num(co->stack_size), nao);
+  abort();
+}
+
+#endif
+
+static void cor_destroy(val obj)
+{
+  struct coroutine *co = coerce(struct coroutine *, obj->co.handle);
+  cor_free_stack(co);
+  free(co);
+}
+
+static void cor_mark(val obj)
+{
+  struct coroutine *co = coerce(struct coroutine *, obj->co.handle);
+
+  gc_mark(co->fun);
+  gc_mark(co->result);
+  gc_mark(co->resumer);
+  gc_mark(co->dyn_env);
+  gc_mark(co->res_dyn_env);
+
+  if (co->state == COR_SUSPENDED) {
+    gc_mark_mem(coerce(val *, &co->jb), coerce(val *, &co->jb + 1));
+    gc_mark_mem(co->top, coerce(val *, co->stack + co->stack_size));
+  }
+}
+
+static struct cobj_ops cor_ops = cobj_ops_init(eq,
+                                               cobj_print_op,
+                                               cor_destroy,
+                                               cor_mark,
+                                               cobj_eq_hash_op);
+
+static size_t cor_stack_size(val self)
+{
+  val size = cdr(lookup_var(nil, obtain_stack_size_s));
+
+  if (!is_num(size) || c_num(size) < convert(cnum, COR_STACK_MIN))
+    uw_throwf(error_s, lit("~a: invalid *obtain-stack-size* ~s; "
+                           "must be an integer no less than ~s"),
+              self, size, num_fast(COR_STACK_MIN), nao);
+
+  return (c_num(size) + sizeof (val) - 1) / sizeof (val) * sizeof (val);
+}
+
+static val make_coroutine(val fun)
+{
+  size_t size = cor_stack_size(lit("obtain"));
+  struct coroutine *co = coerce(struct coroutine *, chk_calloc(1, sizeof *co));
+  co->state = COR_FRESH;
+  co->stack_size = size;
+  co->fun = fun;
+  co->result = nil;
+  co->resumer = nil;
+  co->dyn_env = nil;
+  co->res_dyn_env = nil;
+  return cobj(coerce(mem_t *, co), sys_cor_s, &cor_ops);
+}
+
+/* Called on the coroutine's stack when an unwinding passes out of it into
+   the frames of the resumer. The coroutine cannot be resumed after this. */
+static void cor_leave(struct coroutine *co)
+{
+  co->state = COR_ABORTED;
+  cor_current = co->resumer;
+  co->resumer = nil;
+  /* Until the unwinding lands on the resumer's stack, the stack pointer
+     is outside of what the collector now regards as the stack. */
+  cor_gc_saved = gc_state(0);
+  gc_pop_stack(&co->res_stack);
+}
+
+static void cor_entry(void)
+{
+  val cor = cor_current;
+  struct coroutine *co = cor_struct(cor);
+
+  uw_simple_catch_begin;
+
+  co->base = &uw_catch;
+
+  {
+    uw_block_begin (cor, result);
+    co->exit = &uw_blk;
+    result = funcall1(co->fun, co->result);
+    uw_block_end;
+    co->result = result;
+  }
+
+  uw_unwind {
+    if (uw_curr_exit_point)
+      cor_leave(co);
+  }
+
+  uw_catch_end;
+
+  co->state = COR_DONE;
+  jmp_restore(&co->res_jb, 1);
+  abort();
+}
+
+static val coroutine_resume(val cor, val arg)
+{
+  val self = lit("obtain");
+  struct coroutine *co = cor_struct(cor);
+  val top = nil;
+
+  if (arg == sys_cont_poison_s && co->state != COR_SUSPENDED) {
+    if (co->state != COR_RUNNING) {
+      cor_free_stack(co);
+      co->state = COR_DONE;
+    }
+    return nil;
+  }
+
+  switch (co->state) {
+  case COR_FRESH:
+    cor_alloc_stack(co, self);
+    if (getcontext(&co->uc) != 0) {
+      cor_free_stack(co);
+      uw_throwf(error_s, lit("~a: unable to create coroutine context"),
+                self, nao);
+    }
+    co->uc.uc_stack.ss_sp = co->stack;
+    co->uc.uc_stack.ss_size = co->stack_size;
+    co->uc.uc_link = 0;
+    makecontext(&co->uc, cor_entry, 0);
+    break;
+  case COR_SUSPENDED:
+    break;
+  case COR_RUNNING:
+    uw_throwf(error_s, lit("~a: generator resumed from within itself"),
+              self, nao);
+  case COR_DONE:
+    return co->result;
+  case COR_ABORTED:
+    cor_free_stack(co);
+    uw_throwf(error_s, lit("~a: generator was terminated by a nonlocal exit"),
+              self, nao);
+  }
+
+  co->result = arg;
+  co->resumer = cor_current;
+  co->res_uw = uw_stack;
+  co->res_env = uw_env_stack;
+  co->res_dyn_env = dyn_env;
+
+  if (co->state == COR_SUSPENDED) {
+    if (co->env_top) {
+      uw_frame_t *fr;
+      for (fr = co->env_top; cor_on_stack(co, fr->ev.up_env);
+           fr = fr->ev.up_env)
+        ; /* empty */
+      fr->ev.up_env = uw_find_env();
+      uw_env_stack = co->env_top;
+    }
+    co->base->uw.up = uw_stack;
+    uw_stack = co->uw_top;
+    dyn_env = co->dyn_env;
+  }
+
+  cor_current = cor;
+  gc_push_stack(&co->res_stack, &top, &co->res_jb,
+                coerce(val *, co->stack + co->stack_size));
+
+  if (!jmp_save(&co->res_jb)) {
+    if (co->state == COR_FRESH) {
+      co->state = COR_RUNNING;
+      setcontext(&co->uc);
+    } else {
+      co->state = COR_RUNNING;
+      jmp_restore(&co->jb, 1);
+    }
+    abort();
+  }
+
+  gc_pop_stack(&co->res_stack);
+  cor_current = co->resumer;
+  co->resumer = nil;
+  uw_stack = co->res_uw;
+  uw_env_stack = co->res_env;
+  dyn_env = co->res_dyn_env;
+  co->res_dyn_env = nil;
+
+  if (co->state == COR_DONE)
+    cor_free_stack(co);
+
+  mut(cor);
+  return co->result;
+}
+
+static struct coroutine *cor_yield_check(val tag, val ctx_form)
+{
+  uses_or2;
+  val sym = or2(car(default_null_arg(ctx_form)), sys_cor_yield_s);
+  struct coroutine *co;
+  uw_frame_t *fr;
+
+  if (!cor_current)
+    eval_error(ctx_form, lit("~s: not within obtain"), sym, nao);
+
+  co = cor_struct(cor_current);
+
+  for (fr = uw_stack; fr != co->base; fr = fr->uw.up) {
+    switch (fr->uw.type) {
+    case UW_BLOCK:
+    case UW_CAPTURED_BLOCK:
+      if (fr->bl.tag == tag)
+        return co;
+      break;
+    default:
+      break;
+    }
+  }
+
+  if (tag)
+    eval_error(ctx_form, lit("~s: no block ~s is visible within obtain"),
+               sym, tag, nao);
+  else
+    eval_error(ctx_form, lit("~s: no anonymous block is visible "
+                             "within obtain"), sym, nao);
+  abort();
+}
+
+static val coroutine_yield(val tag, val item, val ctx_form)
+{
+  struct coroutine *co = cor_yield_check(tag, ctx_form);
+  val top = nil;
+
+  co->result = item;
+  co->uw_top = uw_stack;
+  co->env_top = if3(cor_on_stack(co, uw_env_stack), uw_env_stack, 0);
+  co->dyn_env = dyn_env;
+  co->top = &top;
+  co->state = COR_SUSPENDED;
+
+  if (!jmp_save(&co->jb)) {
+    jmp_restore(&co->res_jb, 1);
+    abort();
+  }
+
+  if (co->result == sys_cont_poison_s) {
+    uw_exit_point = co->exit;
+    uw_unwind_to_exit_point();
+  }
+
+  return co->result;
+}
+
+static val coroutine_recv(val tag, val ctx_form)
+{
+  struct coroutine *co = cor_yield_check(tag, ctx_form);
+  return co->result;
+}
+
+#endif
+
 struct cont {
   uw_frame_t *orig;
   cnum size;
@@ -1002,6 +1432,16 @@ val uw_capture_cont(val tag, val fun, val ctx_form)
                                  "spanning external library stack frames"),
                    sym, nao);
       }
+#if HAVE_UCONTEXT
+    case UW_CATCH:
+      if (cor_current && fr == cor_struct(cor_current)->base) {
+        val sym = or2(car(default_null_arg(ctx_form)), sys_capture_cont_s);
+        eval_error(ctx_form, lit("~s: cannot capture continuation "
+                                 "spanning the boundary of obtain"),
+                   sym, nao);
+      }
+      continue;
+#endif
     default:
       continue;
     }
@@ -1040,6 +1480,8 @@ void uw_init(void)
   uw_register_subtype(timeout_error_s, error_s);
   uw_register_subtype(assert_s, error_s);
   uw_register_subtype(syntax_error_s, error_s);
+  stack_overflow_s = intern(lit("stack-overflow"), user_package);
+  uw_register_subtype(stack_overflow_s, error_s);
 }
 
 void uw_late_init(void)
@@ -1088,6 +1530,21 @@ void uw_late_init(void)
           func_n2v(uw_invoke_catch));
   reg_fun(sys_capture_cont_s = intern(lit("capture-cont"), system_package),
           func_n3o(uw_capture_cont, 2));
+#if HAVE_UCONTEXT
+  protect(&cor_current, convert(val *, 0));
+  sys_cor_s = intern(lit("coroutine"), system_package);
+  reg_var(obtain_stack_size_s = intern(lit("*obtain-stack-size*"),
+                                       user_package),
+          num_fast(COR_STACK_SIZE));
+  reg_fun(intern(lit("make-coroutine"), system_package),
+          func_n1(make_coroutine));
+  reg_fun(intern(lit("coroutine-resume"), system_package),
+          func_n2(coroutine_resume));
+  reg_fun(sys_cor_yield_s = intern(lit("coroutine-yield"), system_package),
+          func_n3o(coroutine_yield, 2));
+  reg_fun(intern(lit("coroutine-recv"), system_package),
+          func_n2o(coroutine_recv, 1));
+#endif
   uw_register_subtype(continue_s, restart_s);
   uw_register_subtype(warning_s, t);
   uw_register_subtype(defr_warning_s, warning_s);
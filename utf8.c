@@ -194,6 +194,62 @@ size_t utf8_to_buf(unsigned char *dst, const wchar_t *wsrc, int null_term)
   return nbyte;
 }
 
+/*
+ * Encode up to nchar characters into dst, which must have room for at least
+ * four bytes. Stops when dst is nearly full, or at a character that has
+ * no UTF-8 encoding. The number of characters converted is stored in *pnconv,
+ * and the number of bytes is returned.
+ */
+size_t utf8_encode_buf(unsigned char *dst, size_t size,
+                       const wchar_t *wsrc, size_t nchar, size_t *pnconv)
+{
+  unsigned char *start = dst, *lim = dst + size - 4;
+  const wchar_t *wptr = wsrc, *wend = wsrc + nchar;
+
+  while (wptr < wend && dst <= lim) {
+    wchar_t wch = *wptr;
+
+    if (wch < 0x80) {
+      *dst++ = wch;
+      wptr++;
+      while (wend - wptr >= 4 && lim - dst >= 4 &&
+             ((wptr[0] | wptr[1] | wptr[2] | wptr[3]) & ~0x7F) == 0)
+      {
+        dst[0] = wptr[0];
+        dst[1] = wptr[1];
+        dst[2] = wptr[2];
+        dst[3] = wptr[3];
+        dst += 4;
+        wptr += 4;
+      }
+    } else if (wch < 0x800) {
+      *dst++ = 0xC0 | (wch >> 6);
+      *dst++ = 0x80 | (wch & 0x3F);
+      wptr++;
+    } else if (wch < 0x10000) {
+      if ((wch & 0xFF00) == 0xDC00) {
+        *dst++ = (wch & 0xFF);
+      } else {
+        *dst++ = 0xE0 | (wch >> 12);
+        *dst++ = 0x80 | ((wch >> 6) & 0x3F);
+        *dst++ = 0x80 | (wch & 0x3F);
+      }
+      wptr++;
+    } else if (wch < 0x110000) {
+      *dst++ = 0xF0 | (wch >> 18);
+      *dst++ = 0x80 | ((wch >> 12) & 0x3F);
+      *dst++ = 0x80 | ((wch >> 6) & 0x3F);
+      *dst++ = 0x80 | (wch & 0x3F);
+      wptr++;
+    } else {
+      break;
+    }
+  }
+
+  *pnconv = wptr - wsrc;
+  return dst - start;
+}
+
 size_t utf8_to(char *dst, const wchar_t *wsrc)
 {
   return utf8_to_buf(coerce(unsigned char *, dst), wsrc, 1);
@@ -29,6 +29,8 @@ size_t utf8_from_buf(wchar_t *, const unsigned char *, size_t nbytes);
 size_t utf8_from(wchar_t *, const char *);
 size_t utf8_to_buf(unsigned char *dst, const wchar_t *wsrc, int null_term);
 size_t utf8_to(char *, const wchar_t *);
+size_t utf8_encode_buf(unsigned char *dst, size_t size,
+                       const wchar_t *wsrc, size_t nchar, size_t *pnconv);
 wchar_t *utf8_dup_from(const char *);
 wchar_t *utf8_dup_from_buf(const char *str, size_t size);
 char *utf8_dup_to(const wchar_t *);